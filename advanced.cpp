@@ -1,12 +1,15 @@
 #include "advanced.h"
 
+#include "analyzer.h"
 #include "constants.h"
 #include "error.h"
 #include "heap.h"
 #include "helpers.h"
 #include "object.h"
+#include "resolver.h"
 #include "scheme.h"
 #include "scope.h"
+#include "symbol_table.h"
 
 #include <memory>
 #include <string>
@@ -17,56 +20,60 @@ namespace advanced {
 using Signature = Object*(Object*, Object*);
 
 Object* FDefine(Object* obj, Object* scope) {
-    auto args = GetProperList(obj, kDefine);
+    ProperList args(obj, kDefine);
     if (args.size() <= 1) {
         throw SyntaxError(kDefine + kMustTwoArg);
     }
-    if (Is<Cell>(args[0])) {
-        auto name = As<Cell>(args[0])->GetFirst();
-        auto arg = As<Cell>(args[0])->GetSecond();
+    Object* target = args[0];
+    Object* value;
+    if (Is<Cell>(target)) {
+        auto name = As<Cell>(target)->GetFirst();
+        auto arg = As<Cell>(target)->GetSecond();
+        Root name_root(name);
+        Root arg_root(arg);
 
         auto& heap = Heap::GetHeap();
 
-        As<Cell>(args[0])->SetFirst(heap.Make<Symbol>(kLambda));
-        As<Cell>(args[0])->SetSecond(heap.Make<Cell>());
-        As<Cell>(As<Cell>(args[0])->GetSecond())->SetFirst(arg);
-        As<Cell>(As<Cell>(args[0])->GetSecond())->SetSecond(As<Cell>(obj)->GetSecond());
+        As<Cell>(target)->SetFirst(SymbolTable::Get().Intern(kLambda));
+        As<Cell>(target)->SetSecond(heap.Make<Cell>());
+        As<Cell>(As<Cell>(target)->GetSecond())->SetFirst(arg);
+        As<Cell>(As<Cell>(target)->GetSecond())->SetSecond(As<Cell>(obj)->GetSecond());
 
-        args[1] = args[0];
-        args[0] = name;
-        args.resize(2);
-    }
-    if (args.size() != 2) {
+        value = target;
+        target = name;
+    } else if (args.size() != 2) {
         throw SyntaxError(kDefine + kMustTwoArg);
+    } else {
+        value = args[1];
     }
-    if (!Is<Symbol>(args[0])) {
+    if (!Is<Symbol>(target)) {
         throw SyntaxError(kDefine + " first argument must be a sybmol or lambda prototype");
     }
-    As<Scope>(scope)->AddObject(As<Symbol>(args[0])->GetName(), Eval(args[1], scope));
+    As<Scope>(scope)->AddObject(As<Symbol>(target)->GetId(), Eval(value, scope));
     return nullptr;
 }
 
 Object* FSet(Object* obj, Object* scope) {
-    auto args = GetProperList(obj, kSet);
+    ProperList args(obj, kSet);
     if (args.size() != 2) {
         throw SyntaxError(kSet + kMustTwoArg);
     }
     if (!Is<Symbol>(args[0])) {
         throw SyntaxError(kSet + " first argument must be a sybmol");
     }
-    As<Scope>(scope)->SetObject(As<Symbol>(args[0])->GetName(), Eval(args[1], scope));
+    As<Scope>(scope)->SetObject(As<Symbol>(args[0])->GetId(), Eval(args[1], scope));
     return nullptr;
 }
 
 Object* FIf(Object* obj, Object* scope) {
-    auto args = GetProperList(obj, kIf);
+    ProperList args(obj, kIf);
     if (args.size() != 2 && args.size() != 3) {
         throw SyntaxError(kIf + kMustTwoThreeArg);
     }
     auto res = Eval(args[0], scope);
     bool branch = true;
     if (Is<Bool>(res)) {
-        branch &= As<Bool>(res)->GetValue();
+        branch &= GetBoolValue(res);
     }
     if (branch) {
         return Eval(args[1], scope);
@@ -78,11 +85,12 @@ Object* FIf(Object* obj, Object* scope) {
 }
 
 Object* FSetCar(Object* obj, Object* scope) {
-    auto args = GetProperList(obj, kSetCar);
+    ProperList args(obj, kSetCar);
     if (args.size() != 2) {
         throw SyntaxError(kSetCar + kMustTwoArg);
     }
     auto res = Eval(args[0], scope);
+    Root res_root(res);
     if (!Is<Cell>(res)) {
         throw SyntaxError(kSetCar + " first argument must hold list or pair");
     }
@@ -91,11 +99,12 @@ Object* FSetCar(Object* obj, Object* scope) {
 }
 
 Object* FSetCdr(Object* obj, Object* scope) {
-    auto args = GetProperList(obj, kSetCdr);
+    ProperList args(obj, kSetCdr);
     if (args.size() != 2) {
         throw SyntaxError(kSetCdr + kMustTwoArg);
     }
     auto res = Eval(args[0], scope);
+    Root res_root(res);
     if (!Is<Cell>(res)) {
         throw SyntaxError(kSetCdr + " first argument must hold list or pair");
     }
@@ -108,41 +117,68 @@ Object* FLambda(Object* obj, Object* scope) {
     if (!Is<Cell>(obj)) {
         throw SyntaxError(kLambda + kMustTwoMoreArg);
     }
-    if (As<Cell>(obj)->GetFirst() != nullptr && !Is<Cell>(As<Cell>(obj)->GetFirst())) {
-        throw SyntaxError(kLambda + " first argument must be a list");
-    }
-    auto largs = GetProperList(As<Cell>(obj)->GetFirst());
-    for (const auto& arg : largs) {
-        if (!Is<Symbol>(arg)) {
-            throw SyntaxError(kLambda + " first argument must hold only symbols");
+    auto cell = As<Cell>(obj);
+    // the first evaluation of a lambda expression resolves its body and puts the FrameLayout in
+    // place of the argument list
+    if (!Is<FrameLayout>(cell->GetFirst())) {
+        if (cell->GetFirst() != nullptr && !Is<Cell>(cell->GetFirst())) {
+            throw SyntaxError(kLambda + " first argument must be a list");
         }
-    }
-    if (!Is<Cell>(As<Cell>(obj)->GetSecond())) {
-        throw SyntaxError(kLambda + " ill format body");
-    }
-    return Heap::GetHeap().Make<Lambda>(kLambda, As<Cell>(obj)->GetFirst(),
-                                        As<Cell>(obj)->GetSecond(), scope);
+        for (Object* arg : ProperList(cell->GetFirst())) {
+            if (!Is<Symbol>(arg)) {
+                throw SyntaxError(kLambda + " first argument must hold only symbols");
+            }
+        }
+        if (!Is<Cell>(cell->GetSecond())) {
+            throw SyntaxError(kLambda + " ill format body");
+        }
+        cell->SetFirst(Resolve(cell->GetFirst(), cell->GetSecond(), scope));
+        As<FrameLayout>(cell->GetFirst())->SetAnalyzedBody(Analyze(cell->GetSecond(), scope));
+    }
+    Object* closure_scope = Capture(cell->GetFirst(), scope);
+    As<Scope>(closure_scope)->MarkCaptured();
+    Root closure_scope_root(closure_scope);
+    return Heap::GetHeap().Make<Lambda>(kLambda, cell->GetFirst(), cell->GetSecond(),
+                                        closure_scope);
 }
 
-Object* FEvalLambda(const std::vector<Object*>& names, const std::vector<Object*>& args,
-                    const std::vector<Object*>& body, Object* lambda_scope, Object* eval_scope) {
-    auto& heap = Heap::GetHeap();
+namespace {
 
-    Object* new_scope = heap.Make<Scope>(lambda_scope);
-    // prepare new scope
-    if (args.size() != names.size()) {
+Object* MakeFrame(Object* layout, const ProperList& args, Object* lambda_scope,
+                  Object* eval_scope) {
+    if (args.size() != As<FrameLayout>(layout)->GetArgCount()) {
         throw RuntimeError(kLambda + " must have as much arguments as prototype has");
     }
-    for (size_t id = 0; id < names.size(); ++id) {
-        As<Scope>(new_scope)->AddObject(As<Symbol>(names[id])->GetName(),
-                                        Eval(args[id], eval_scope));
+    Object* new_scope = Heap::GetHeap().MakeFrame(lambda_scope, layout);
+    Root new_scope_root(new_scope);
+    // arguments take the first slots
+    size_t id = 0;
+    for (Object* arg : args) {
+        As<Scope>(new_scope)->SetSlot(id++, Eval(arg, eval_scope));
     }
+    return new_scope;
+}
+
+}  // namespace
+
+Object* FEvalLambda(Object* layout, const ProperList& args, const ProperList& body,
+                    Object* lambda_scope, Object* eval_scope) {
+    Object* new_scope = MakeFrame(layout, args, lambda_scope, eval_scope);
+    Root new_scope_root(new_scope);
     // evaluate
     Object* res;
-    for (const auto& elem : body) {
+    for (Object* elem : body) {
         res = Eval(elem, new_scope);
     }
+    Heap::GetHeap().ReleaseFrame(new_scope);
     return res;
 }
 
+Object* FEvalLambda(Object* layout, const ProperList& args, Object* body, Object* lambda_scope,
+                    Object* eval_scope) {
+    Object* new_scope = MakeFrame(layout, args, lambda_scope, eval_scope);
+    Root new_scope_root(new_scope);
+    return As<AnalyzedBody>(body)->Execute(new_scope);
+}
+
 }  // namespace advanced
\ No newline at end of file
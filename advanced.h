@@ -1,6 +1,7 @@
 #pragma once
 
 #include "constants.h"
+#include "helpers.h"
 #include "object.h"
 #include "scope.h"
 #include "heap.h"
@@ -23,17 +24,22 @@ Object* FSetCdr(Object* obj, Object* scope);
 
 Object* FLambda(Object* obj, Object* scope);
 
-// obj holds ((arg_names) (args) body ...)
-Object* FEvalLambda(const std::vector<Object*>& names, const std::vector<Object*>& args,
-                    const std::vector<Object*>& body, Object* lambda_scope, Object* eval_scope);
+// binds `args` evaluated in `eval_scope` to the first slots of a new frame described by `layout`
+Object* FEvalLambda(Object* layout, const ProperList& args, const ProperList& body,
+                    Object* lambda_scope, Object* eval_scope);
+// same with the AnalyzedBody of the lambda
+Object* FEvalLambda(Object* layout, const ProperList& args, Object* body, Object* lambda_scope,
+                    Object* eval_scope);
 
 }  // namespace advanced
 
-const std::vector<std::pair<std::string, Object*>> kAdvancedFunctions = {
-    {kDefine, Heap::GetHeap().Make<Reserved>(kDefine, advanced::FDefine)},
-    {kSet, Heap::GetHeap().Make<Reserved>(kSet, advanced::FSet)},
-    {kIf, Heap::GetHeap().Make<Reserved>(kIf, advanced::FIf)},
-    {kSetCar, Heap::GetHeap().Make<Reserved>(kSetCar, advanced::FSetCar)},
-    {kSetCdr, Heap::GetHeap().Make<Reserved>(kSetCdr, advanced::FSetCdr)},
-    {kLambda, Heap::GetHeap().Make<Reserved>(kLambda, advanced::FLambda)},
+inline const std::vector<std::pair<std::string, Object*>> kAdvancedFunctions = {
+    {kDefine,
+     Heap::GetHeap().MakePermanent<Reserved>(kDefine, advanced::FDefine, 2, Reserved::kVariadic)},
+    {kSet, Heap::GetHeap().MakePermanent<Reserved>(kSet, advanced::FSet, 2, 2)},
+    {kIf, Heap::GetHeap().MakePermanent<Reserved>(kIf, advanced::FIf, 2, 3)},
+    {kSetCar, Heap::GetHeap().MakePermanent<Reserved>(kSetCar, advanced::FSetCar, 2, 2)},
+    {kSetCdr, Heap::GetHeap().MakePermanent<Reserved>(kSetCdr, advanced::FSetCdr, 2, 2)},
+    {kLambda,
+     Heap::GetHeap().MakePermanent<Reserved>(kLambda, advanced::FLambda, 2, Reserved::kVariadic)},
 };
\ No newline at end of file
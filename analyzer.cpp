@@ -0,0 +1,706 @@
+#include "analyzer.h"
+
+#include "advanced.h"
+#include "assertions.h"
+#include "basics.h"
+#include "constants.h"
+#include "error.h"
+#include "folder.h"
+#include "heap.h"
+#include "helpers.h"
+#include "jit.h"
+#include "object.h"
+#include "scheme.h"
+#include "scope.h"
+#include "stack_limit.h"
+#include "symbol_table.h"
+
+#include <array>
+#include <functional>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+class Node {
+public:
+    virtual ~Node() = default;
+    virtual Object* Execute(Object* scope) = 0;
+    // executes the node in tail position of a body. A call of a lambda with an analyzed body
+    // only makes the frame of the call and returns it in `frame`, the caller runs the body
+    virtual Object* ExecuteTail(Object* scope, Object*& /*frame*/) {
+        return Execute(scope);
+    }
+};
+
+namespace {
+
+AnalyzedBody* GetAnalyzedBody(Object* frame) {
+    auto layout = static_cast<FrameLayout*>(static_cast<Scope*>(frame)->GetLayout());
+    return static_cast<AnalyzedBody*>(layout->GetAnalyzedBody());
+}
+
+using References = std::vector<Object**>;
+
+SiteStats site_stats;
+
+Object* CallFunction(Object* func, Object* args, Object* scope) {
+    Root func_root(func);
+    if (!Is<Function>(func)) {
+        throw RuntimeError("Unknown function");
+    }
+    return static_cast<Function*>(func)->Call(args, scope);
+}
+
+class ConstNode : public Node {
+public:
+    ConstNode(Object* value, References& references) : value_(value) {
+        references.push_back(&value_);
+    }
+
+    virtual Object* Execute(Object*) override {
+        return value_;
+    }
+
+private:
+    Object* value_;
+};
+
+// the empty list, dots, lambda expressions evaluated after `lambda` was rebound and calls with
+// an improper argument list are left to Eval
+class EvalNode : public Node {
+public:
+    EvalNode(Object* obj, References& references) : obj_(obj) {
+        references.push_back(&obj_);
+    }
+
+    virtual Object* Execute(Object* scope) override {
+        return Eval(obj_, scope);
+    }
+
+private:
+    Object* obj_;
+};
+
+class LocalNode : public Node {
+public:
+    LocalNode(LocalSymbol* local)
+        : depth_(local->GetDepth()), slot_(local->GetSlot()), name_(local->GetId()) {
+    }
+
+    virtual Object* Execute(Object* scope) override {
+        return static_cast<Scope*>(scope)->GetLocal(depth_, slot_, name_);
+    }
+
+private:
+    uint32_t depth_;
+    uint32_t slot_;
+    uint32_t name_;
+};
+
+class GlobalNode : public Node {
+public:
+    GlobalNode(Object* symbol, References& references) : symbol_(symbol) {
+        references.push_back(&symbol_);
+    }
+
+    virtual Object* Execute(Object* scope) override {
+        return static_cast<Scope*>(scope)->GetGlobal(static_cast<GlobalSymbol*>(symbol_));
+    }
+
+private:
+    Object* symbol_;
+};
+
+class NameNode : public Node {
+public:
+    NameNode(uint32_t name) : name_(name) {
+    }
+
+    virtual Object* Execute(Object* scope) override {
+        return static_cast<Scope*>(scope)->GetObject(name_);
+    }
+
+private:
+    uint32_t name_;
+};
+
+class CallNode : public Node {
+public:
+    CallNode(std::unique_ptr<Node> head, std::vector<std::unique_ptr<Node>> args, Object* args_list,
+             References& references)
+        : head_(std::move(head)), args_(std::move(args)), args_list_(args_list) {
+        references.push_back(&args_list_);
+    }
+
+    virtual Object* Execute(Object* scope) override {
+        StackLimit::Check();
+        Object* func = head_->Execute(scope);
+        if (!IsAnalyzedLambda(func)) {
+            return CallFunction(func, args_list_, scope);
+        }
+        Object* frame = MakeFrame(func, scope);
+        return GetAnalyzedBody(frame)->Execute(frame);
+    }
+
+    virtual Object* ExecuteTail(Object* scope, Object*& frame) override {
+        Object* func = head_->Execute(scope);
+        if (!IsAnalyzedLambda(func)) {
+            return CallFunction(func, args_list_, scope);
+        }
+        frame = MakeFrame(func, scope);
+        return nullptr;
+    }
+
+private:
+    static bool IsAnalyzedLambda(Object* func) {
+        return Is<Lambda>(func) &&
+               static_cast<FrameLayout*>(static_cast<Lambda*>(func)->GetLayout())
+                   ->GetAnalyzedBody();
+    }
+
+    // the frame of a call of the lambda with the evaluated arguments
+    Object* MakeFrame(Object* func, Object* scope) {
+        auto lambda = static_cast<Lambda*>(func);
+        auto layout = static_cast<FrameLayout*>(lambda->GetLayout());
+        if (args_.size() != layout->GetArgCount()) {
+            throw RuntimeError(kLambda + " must have as much arguments as prototype has");
+        }
+        Root func_root(func);
+        Object* frame = Heap::GetHeap().MakeFrame(lambda->GetScope(), layout);
+        Root frame_root(frame);
+        for (size_t id = 0; id < args_.size(); ++id) {
+            static_cast<Scope*>(frame)->SetSlot(id, args_[id]->Execute(scope));
+        }
+        return frame;
+    }
+
+    std::unique_ptr<Node> head_;
+    std::vector<std::unique_ptr<Node>> args_;
+    Object* args_list_;
+};
+
+// runs the inlined form while the head still refers to the builtin
+class GuardNode : public Node {
+public:
+    GuardNode(std::unique_ptr<Node> head, Object* builtin, std::unique_ptr<Node> inlined,
+              Object* args_list, References& references)
+        : head_(std::move(head)),
+          builtin_(builtin),
+          inlined_(std::move(inlined)),
+          args_list_(args_list) {
+        references.push_back(&args_list_);
+    }
+
+    virtual Object* Execute(Object* scope) override {
+        Object* func = head_->Execute(scope);
+        if (func == builtin_) {
+            return inlined_->Execute(scope);
+        }
+        return CallFunction(func, args_list_, scope);
+    }
+
+    virtual Object* ExecuteTail(Object* scope, Object*& frame) override {
+        Object* func = head_->Execute(scope);
+        if (func == builtin_) {
+            return inlined_->ExecuteTail(scope, frame);
+        }
+        return CallFunction(func, args_list_, scope);
+    }
+
+private:
+    std::unique_ptr<Node> head_;
+    // permanent, never moves
+    Object* builtin_;
+    std::unique_ptr<Node> inlined_;
+    Object* args_list_;
+};
+
+// calls a primitive builtin with the values of the argument nodes, the arity is checked during
+// the analysis
+class PrimitiveNode : public Node {
+public:
+    PrimitiveNode(Reserved::Primitive* primitive, std::vector<std::unique_ptr<Node>> args)
+        : primitive_(primitive), args_(std::move(args)) {
+    }
+
+    virtual Object* Execute(Object* scope) override {
+        std::array<Object*, Reserved::kMaxPrimitiveArgs> values = {};
+        Root first_root(values[0]);
+        Root second_root(values[1]);
+        for (size_t id = 0; id < args_.size(); ++id) {
+            values[id] = args_[id]->Execute(scope);
+        }
+        return primitive_(values.data());
+    }
+
+private:
+    Reserved::Primitive* primitive_;
+    std::vector<std::unique_ptr<Node>> args_;
+};
+
+// call site of a binary arithmetic or comparison builtin, see SiteStats
+template <class Operation>
+class BinarySiteNode : public Node {
+public:
+    BinarySiteNode(std::unique_ptr<Node> head, Object* builtin,
+                   std::vector<std::unique_ptr<Node>> args, Object* args_list,
+                   References& references)
+        : head_(std::move(head)),
+          builtin_(builtin),
+          first_(std::move(args[0])),
+          second_(std::move(args[1])),
+          args_list_(args_list) {
+        references.push_back(&args_list_);
+        ++site_stats.sites;
+    }
+
+    virtual Object* Execute(Object* scope) override {
+        Object* func = head_->Execute(scope);
+        switch (state_) {
+            case State::kFixnum:
+                return ExecuteFixnum(func, scope);
+            case State::kGeneric:
+                return ExecuteGeneric(func, scope);
+            default:
+                return ExecuteUninitialized(func, scope);
+        }
+    }
+
+private:
+    enum class State { kUninitialized, kFixnum, kGeneric };
+
+    // the arguments may run the site again before it is rewritten, a nested call seeing other
+    // types wins
+    Object* ExecuteUninitialized(Object* func, Object* scope) {
+        if (func != builtin_) {
+            Deoptimize();
+            return CallFunction(func, args_list_, scope);
+        }
+        Object* first = first_->Execute(scope);
+        if (!IsFixnum(first)) {
+            Deoptimize();
+            return CallBuiltin(first, scope);
+        }
+        Object* second = second_->Execute(scope);
+        if (!IsFixnum(second)) {
+            Deoptimize();
+            return Apply(GetFixnumValue(first), CheckNumber(second));
+        }
+        if (state_ == State::kUninitialized) {
+            state_ = State::kFixnum;
+            ++site_stats.specialized;
+        }
+        return Apply(GetFixnumValue(first), GetFixnumValue(second));
+    }
+
+    Object* ExecuteFixnum(Object* func, Object* scope) {
+        if (func != builtin_) {
+            Deoptimize();
+            return CallFunction(func, args_list_, scope);
+        }
+        Object* first = first_->Execute(scope);
+        if (!IsFixnum(first)) {
+            Deoptimize();
+            return CallBuiltin(first, scope);
+        }
+        Object* second = second_->Execute(scope);
+        if (!IsFixnum(second)) {
+            Deoptimize();
+            return Apply(GetFixnumValue(first), CheckNumber(second));
+        }
+        return Apply(GetFixnumValue(first), GetFixnumValue(second));
+    }
+
+    Object* ExecuteGeneric(Object* func, Object* scope) {
+        if (func != builtin_) {
+            return CallFunction(func, args_list_, scope);
+        }
+        return CallBuiltin(first_->Execute(scope), scope);
+    }
+
+    void Deoptimize() {
+        if (state_ == State::kFixnum) {
+            ++site_stats.deoptimized;
+        }
+        state_ = State::kGeneric;
+    }
+
+    // finishes the call of the builtin once the first argument is evaluated, every argument is
+    // checked right after it is evaluated
+    Object* CallBuiltin(Object* first, Object* scope) {
+        Root first_root(first);
+        int64_t value = CheckNumber(first);
+        return Apply(value, CheckNumber(second_->Execute(scope)));
+    }
+
+    int64_t CheckNumber(Object* obj) {
+        if (!Is<Number>(obj)) {
+            throw RuntimeError(static_cast<Reserved*>(builtin_)->GetName() + kMustBeNum);
+        }
+        return GetNumberValue(obj);
+    }
+
+    static Object* Apply(int64_t first, int64_t second) {
+        auto res = Operation{}(first, second);
+        if constexpr (std::is_same_v<decltype(res), bool>) {
+            return MakeBool(res);
+        } else {
+            return MakeNumber(res);
+        }
+    }
+
+    std::unique_ptr<Node> head_;
+    // permanent, never moves
+    Object* builtin_;
+    std::unique_ptr<Node> first_;
+    std::unique_ptr<Node> second_;
+    Object* args_list_;
+    State state_ = State::kUninitialized;
+};
+
+template <class Operation>
+std::unique_ptr<Node> MakeBinarySite(std::unique_ptr<Node> head, Object* builtin,
+                                     std::vector<std::unique_ptr<Node>> args, Object* args_list,
+                                     References& references) {
+    return std::make_unique<BinarySiteNode<Operation>>(std::move(head), builtin, std::move(args),
+                                                       args_list, references);
+}
+
+using BinarySiteFactory = decltype(&MakeBinarySite<std::plus<int64_t>>);
+
+// factories of the call sites by the ids of the builtin names
+const std::unordered_map<uint32_t, BinarySiteFactory>& GetBinarySites() {
+    static const std::unordered_map<uint32_t, BinarySiteFactory> sites = [] {
+        const std::vector<std::pair<std::string, BinarySiteFactory>> names = {
+            {kPlus, MakeBinarySite<std::plus<int64_t>>},
+            {kMinus, MakeBinarySite<std::minus<int64_t>>},
+            {kMultiply, MakeBinarySite<std::multiplies<int64_t>>},
+            {kEqual, MakeBinarySite<std::equal_to<int64_t>>},
+            {kLess, MakeBinarySite<std::less<int64_t>>},
+            {kGreater, MakeBinarySite<std::greater<int64_t>>},
+            {kLEqual, MakeBinarySite<std::less_equal<int64_t>>},
+            {kGEqual, MakeBinarySite<std::greater_equal<int64_t>>},
+        };
+        std::unordered_map<uint32_t, BinarySiteFactory> sites;
+        for (const auto& [name, factory] : names) {
+            sites[SymbolTable::Get().GetId(name)] = factory;
+        }
+        return sites;
+    }();
+    return sites;
+}
+
+// a folded expression, runs the unfolded one for good once a builtin may have been rebound
+class FoldedNode : public Node {
+public:
+    FoldedNode(std::unique_ptr<Node> folded, std::unique_ptr<Node> unfolded)
+        : folded_(std::move(folded)),
+          unfolded_(std::move(unfolded)),
+          epoch_(Scope::GetBuiltinEpoch()) {
+    }
+
+    virtual Object* Execute(Object* scope) override {
+        if (IsValid()) {
+            return folded_->Execute(scope);
+        }
+        return unfolded_->Execute(scope);
+    }
+
+    virtual Object* ExecuteTail(Object* scope, Object*& frame) override {
+        if (IsValid()) {
+            return folded_->ExecuteTail(scope, frame);
+        }
+        return unfolded_->ExecuteTail(scope, frame);
+    }
+
+private:
+    bool IsValid() {
+        if (valid_ && Scope::GetBuiltinEpoch() != epoch_) {
+            valid_ = false;
+        }
+        return valid_;
+    }
+
+    // kept after the invalidation, the references of the body point into it
+    std::unique_ptr<Node> folded_;
+    std::unique_ptr<Node> unfolded_;
+    size_t epoch_;
+    bool valid_ = true;
+};
+
+class IfNode : public Node {
+public:
+    IfNode(std::unique_ptr<Node> condition, std::unique_ptr<Node> then,
+           std::unique_ptr<Node> otherwise)
+        : condition_(std::move(condition)),
+          then_(std::move(then)),
+          otherwise_(std::move(otherwise)) {
+    }
+
+    virtual Object* Execute(Object* scope) override {
+        Object* res = condition_->Execute(scope);
+        if (!Is<Bool>(res) || GetBoolValue(res)) {
+            return then_->Execute(scope);
+        }
+        return otherwise_ ? otherwise_->Execute(scope) : nullptr;
+    }
+
+    virtual Object* ExecuteTail(Object* scope, Object*& frame) override {
+        Object* res = condition_->Execute(scope);
+        if (!Is<Bool>(res) || GetBoolValue(res)) {
+            return then_->ExecuteTail(scope, frame);
+        }
+        return otherwise_ ? otherwise_->ExecuteTail(scope, frame) : nullptr;
+    }
+
+private:
+    std::unique_ptr<Node> condition_;
+    std::unique_ptr<Node> then_;
+    std::unique_ptr<Node> otherwise_;
+};
+
+// `and` stops at the first #f, `or` at the first #t
+class BoolOpNode : public Node {
+public:
+    BoolOpNode(bool stop_value, std::vector<std::unique_ptr<Node>> args)
+        : stop_value_(stop_value), args_(std::move(args)) {
+    }
+
+    virtual Object* Execute(Object* scope) override {
+        Object* last = MakeBool(!stop_value_);
+        for (const auto& arg : args_) {
+            last = arg->Execute(scope);
+            if (Is<Bool>(last) && GetBoolValue(last) == stop_value_) {
+                break;
+            }
+        }
+        return last;
+    }
+
+    // the last argument is in tail position
+    virtual Object* ExecuteTail(Object* scope, Object*& frame) override {
+        if (args_.empty()) {
+            return MakeBool(!stop_value_);
+        }
+        for (size_t id = 0; id + 1 < args_.size(); ++id) {
+            Object* last = args_[id]->Execute(scope);
+            if (Is<Bool>(last) && GetBoolValue(last) == stop_value_) {
+                return last;
+            }
+        }
+        return args_.back()->ExecuteTail(scope, frame);
+    }
+
+private:
+    bool stop_value_;
+    std::vector<std::unique_ptr<Node>> args_;
+};
+
+class Analyzer {
+public:
+    // `scope` is where the lambda is created
+    explicit Analyzer(Object* scope) : scope_(scope) {
+    }
+
+    std::unique_ptr<Node> Analyze(Object* obj) {
+        if (!obj) {
+            return std::make_unique<EvalNode>(obj, references_);
+        }
+        switch (GetObjectType(obj)) {
+            case ObjectType::kNumber:
+            case ObjectType::kBool:
+                return std::make_unique<ConstNode>(obj, references_);
+            case ObjectType::kDot:
+            case ObjectType::kFrameLayout:
+                return std::make_unique<EvalNode>(obj, references_);
+            case ObjectType::kLocalSymbol:
+                return std::make_unique<LocalNode>(static_cast<LocalSymbol*>(obj));
+            case ObjectType::kGlobalSymbol:
+                return std::make_unique<GlobalNode>(obj, references_);
+            case ObjectType::kSymbol:
+            case ObjectType::kLambda:
+            case ObjectType::kReserved:
+                return std::make_unique<NameNode>(static_cast<Symbol*>(obj)->GetId());
+            default:
+                ASSERT(Is<Cell>(obj), "Unknown Object");
+        }
+        return AnalyzeCall(static_cast<Cell*>(obj));
+    }
+
+    References& GetReferences() {
+        return references_;
+    }
+
+private:
+    std::unique_ptr<Node> AnalyzeCall(Cell* form) {
+        Object* args_list = form->GetSecond();
+        if (!CheckProperList(args_list)) {
+            return std::make_unique<EvalNode>(form, references_);
+        }
+        if (fold_) {
+            if (auto folded = AnalyzeFolded(form)) {
+                return folded;
+            }
+        }
+        auto args = GetProperList(args_list);
+        auto head = Analyze(form->GetFirst());
+        auto symbol = As<Symbol>(form->GetFirst());
+        auto builtin = symbol ? As<Reserved>(FindBuiltin(symbol->GetId())) : nullptr;
+        if (builtin && args.size() == 2) {
+            const auto& sites = GetBinarySites();
+            if (auto it = sites.find(symbol->GetId()); it != sites.end()) {
+                return it->second(std::move(head), builtin, AnalyzeList(args), args_list,
+                                  references_);
+            }
+        }
+        if (builtin && builtin->Accepts(args.size())) {
+            auto inlined = AnalyzeSpecialForm(symbol->GetId(), args);
+            if (!inlined && builtin->GetPrimitive()) {
+                inlined =
+                    std::make_unique<PrimitiveNode>(builtin->GetPrimitive(), AnalyzeList(args));
+            }
+            if (inlined) {
+                return std::make_unique<GuardNode>(std::move(head), builtin, std::move(inlined),
+                                                   args_list, references_);
+            }
+        }
+        return std::make_unique<CallNode>(std::move(head), AnalyzeList(args), args_list,
+                                          references_);
+    }
+
+    // nullptr unless the call is a constant expression or an if with a constant test. The
+    // unfolded call is analyzed without folding, it only runs once every fold is invalid
+    std::unique_ptr<Node> AnalyzeFolded(Cell* form) {
+        static Object* const kIfBuiltin = FindBuiltin(SymbolTable::Get().GetId(kIf));
+        std::unique_ptr<Node> folded;
+        Object* value;
+        if (FoldConstant(form, scope_, value)) {
+            folded = std::make_unique<ConstNode>(value, references_);
+        } else if (FoldBuiltin(form->GetFirst(), scope_) == kIfBuiltin) {
+            ProperList args(form->GetSecond());
+            if (args.size() != 2 && args.size() != 3) {
+                return nullptr;
+            }
+            if (!FoldConstant(args[0], scope_, value)) {
+                return nullptr;
+            }
+            if (!Is<Bool>(value) || GetBoolValue(value)) {
+                folded = Analyze(args[1]);
+            } else if (args.size() == 3) {
+                folded = Analyze(args[2]);
+            } else {
+                folded = std::make_unique<ConstNode>(nullptr, references_);
+            }
+        } else {
+            return nullptr;
+        }
+        fold_ = false;
+        auto unfolded = AnalyzeCall(form);
+        fold_ = true;
+        return std::make_unique<FoldedNode>(std::move(folded), std::move(unfolded));
+    }
+
+    // nullptr unless `name` is a special form accepting the arguments
+    std::unique_ptr<Node> AnalyzeSpecialForm(uint32_t name, const std::vector<Object*>& args) {
+        static const uint32_t kIfId = SymbolTable::Get().GetId(kIf);
+        static const uint32_t kQuoteId = SymbolTable::Get().GetId(kQuote);
+        static const uint32_t kAndId = SymbolTable::Get().GetId(kAnd);
+        static const uint32_t kOrId = SymbolTable::Get().GetId(kOr);
+        if (name == kIfId && (args.size() == 2 || args.size() == 3)) {
+            return std::make_unique<IfNode>(Analyze(args[0]), Analyze(args[1]),
+                                            args.size() == 3 ? Analyze(args[2]) : nullptr);
+        }
+        if (name == kQuoteId && args.size() == 1) {
+            return std::make_unique<ConstNode>(args[0], references_);
+        }
+        if (name == kAndId || name == kOrId) {
+            return std::make_unique<BoolOpNode>(name == kOrId, AnalyzeList(args));
+        }
+        return nullptr;
+    }
+
+    std::vector<std::unique_ptr<Node>> AnalyzeList(const std::vector<Object*>& objs) {
+        std::vector<std::unique_ptr<Node>> nodes;
+        nodes.reserve(objs.size());
+        for (const auto& obj : objs) {
+            nodes.push_back(Analyze(obj));
+        }
+        return nodes;
+    }
+
+    Object* scope_;
+    bool fold_ = true;
+    References references_;
+};
+
+}  // namespace
+
+const SiteStats& GetSiteStats() {
+    return site_stats;
+}
+
+AnalyzedBody::AnalyzedBody(std::vector<std::unique_ptr<Node>> forms,
+                           std::vector<Object**> references)
+    : Object(ObjectType::kAnalyzedBody),
+      forms_(std::move(forms)),
+      references_(std::move(references)) {
+    for (const auto& reference : references_) {
+        Heap::GetHeap().WriteBarrier(this, *reference);
+    }
+}
+
+AnalyzedBody::AnalyzedBody(AnalyzedBody&& other) = default;
+
+AnalyzedBody::~AnalyzedBody() = default;
+
+Object* AnalyzedBody::Execute(Object* frame) {
+    Root frame_root(frame);
+    AnalyzedBody* body = this;
+    // tail calls replace the frame and the body instead of recursing, the body stays reachable
+    // through the layout of the frame. The replaced frame is released, its arguments are
+    // already evaluated into the new one
+    while (true) {
+        Object* res;
+        if (Jit::Run(frame, res)) {
+            Heap::GetHeap().ReleaseFrame(frame);
+            return res;
+        }
+        for (size_t id = 0; id + 1 < body->forms_.size(); ++id) {
+            body->forms_[id]->Execute(frame);
+        }
+        Object* next = nullptr;
+        res = body->forms_.back()->ExecuteTail(frame, next);
+        Heap::GetHeap().ReleaseFrame(frame);
+        if (!next) {
+            return res;
+        }
+        frame = next;
+        body = GetAnalyzedBody(frame);
+    }
+}
+
+void AnalyzedBody::Trace(Tracer& tracer) {
+    for (const auto& reference : references_) {
+        tracer.Visit(*reference);
+    }
+}
+
+Object* AnalyzedBody::MoveTo(void* slot) {
+    return new (slot) AnalyzedBody(std::move(*this));
+}
+
+Object* Analyze(Object* body, Object* scope) {
+    if (!CheckProperList(body)) {
+        return nullptr;
+    }
+    Analyzer analyzer(scope);
+    std::vector<std::unique_ptr<Node>> forms;
+    for (Object* form = body; form; form = As<Cell>(form)->GetSecond()) {
+        forms.push_back(analyzer.Analyze(As<Cell>(form)->GetFirst()));
+    }
+    return Heap::GetHeap().Make<AnalyzedBody>(std::move(forms),
+                                              std::move(analyzer.GetReferences()));
+}
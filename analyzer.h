@@ -0,0 +1,56 @@
+#pragma once
+
+#include "object.h"
+
+#include <memory>
+#include <vector>
+
+// executable node of an analyzed lambda body
+class Node;
+
+// Body of a lambda converted once into a tree of executable nodes. Calls of if, quote, and and
+// or are recognized behind a guard checking that the name still refers to the builtin, primitive
+// builtins are called with the values of the argument nodes behind the same guard, argument
+// lists are flattened and checked, constants are hoisted into the nodes. Calls of lambdas with
+// an analyzed body evaluate the argument nodes straight into the new frame, every other call goes
+// through Function::Call with the unevaluated arguments. Tail positions are the last form of the
+// body, the branches of if and the last argument of and and or.
+class AnalyzedBody : public Object {
+public:
+    static constexpr ObjectType kFirstType = ObjectType::kAnalyzedBody;
+    static constexpr ObjectType kLastType = ObjectType::kAnalyzedBody;
+
+    AnalyzedBody(std::vector<std::unique_ptr<Node>> forms, std::vector<Object**> references);
+    AnalyzedBody(AnalyzedBody&& other);
+    ~AnalyzedBody();
+
+    // evaluates the forms in the frame of a call, returns the value of the last one. Calls in
+    // tail position run in the same loop without growing the native stack. Takes over the frame:
+    // it is released once the body returns, see Heap::ReleaseFrame
+    Object* Execute(Object* frame);
+
+protected:
+    virtual void Trace(Tracer& tracer) override;
+    virtual Object* MoveTo(void* slot) override;
+
+private:
+    std::vector<std::unique_ptr<Node>> forms_;
+    // the object fields of the nodes
+    std::vector<Object**> references_;
+};
+
+// analyzes the body of a resolved lambda created in `scope`, nullptr if the body is not a proper
+// list. Constant expressions are folded, see FoldConstant
+Object* Analyze(Object* body, Object* scope);
+
+// Calls of the binary arithmetic and comparison builtins are self-optimizing sites. A site starts
+// uninitialized and rewrites itself on its first call: into a fixnum node if it called the
+// builtin with two fixnums, into the generic node otherwise. A fixnum node deoptimizes into the
+// generic node for good once the name is rebound or an argument is not a fixnum.
+struct SiteStats {
+    size_t sites = 0;
+    size_t specialized = 0;
+    size_t deoptimized = 0;
+};
+
+const SiteStats& GetSiteStats();
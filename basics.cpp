@@ -18,18 +18,10 @@ using Signature = Object*(Object*, Object*);
 // ---- functions ----
 
 //   -- unary --
-Object* FBoolFunctor(Object* obj, std::function<bool(Object*)> func, const std::string& context,
-                     Object* scope) {
-    auto args = GetProperList(obj, context);
-    if (args.size() != 1) {
-        throw RuntimeError(context + kMustOneArg);
-    }
-    return Heap::GetHeap().Make<Bool>(func(Eval(args[0], scope)));
-}
 
 // - special
 Object* FQuote(Object* obj, Object*) {
-    auto args = GetProperList(obj, kQuote);
+    ProperList args(obj, kQuote);
     if (args.size() != 1) {
         throw RuntimeError(kQuote + kMustOneArg);
     }
@@ -37,156 +29,129 @@ Object* FQuote(Object* obj, Object*) {
 }
 
 // - integer
-Object* FAbs(Object* obj, Object* scope) {
-    auto args = GetProperList(obj, kAbs);
-    if (args.size() != 1) {
-        throw RuntimeError(kAbs + kMustOneArg);
-    }
-    auto res = Eval(args[0], scope);
-    if (!Is<Number>(res)) {
+Object* FAbs(Object* const* args) {
+    if (!Is<Number>(args[0])) {
         throw RuntimeError(kAbs + kMustBeNum);
     }
-    return Heap::GetHeap().Make<Number>(std::abs(As<Number>(res)->GetValue()));
+    return MakeNumber(std::abs(GetNumberValue(args[0])));
 }
 
-Object* FIsNumber(Object* obj, Object* scope) {
-    return FBoolFunctor(
-        obj, [](Object* obj) { return Is<Number>(obj); }, kIsNumber, scope);
+Object* FIsNumber(Object* const* args) {
+    return MakeBool(Is<Number>(args[0]));
 }
 
 // - boolean
-Object* FIsBool(Object* obj, Object* scope) {
-    return FBoolFunctor(
-        obj, [](Object* obj) { return Is<Bool>(obj); }, kIsBool, scope);
+Object* FIsBool(Object* const* args) {
+    return MakeBool(Is<Bool>(args[0]));
 }
 
-Object* FNot(Object* obj, Object* scope) {
-    return FBoolFunctor(
-        obj,
-        [](Object* obj) {
-            bool res = false;
-            if (Is<Bool>(obj)) {
-                res = (res || !As<Bool>(obj)->GetValue());
-            }
-            return res;
-        },
-        kNot, scope);
+Object* FNot(Object* const* args) {
+    return MakeBool(Is<Bool>(args[0]) && !GetBoolValue(args[0]));
 }
 
 // - list
-Object* FIsPair(Object* obj, Object* scope) {
-    return FBoolFunctor(
-        obj, [](Object* obj) { return CheckPair(obj); }, kIsPair, scope);
+Object* FIsPair(Object* const* args) {
+    return MakeBool(CheckPair(args[0]));
 }
 
-Object* FIsNull(Object* obj, Object* scope) {
-    return FBoolFunctor(
-        obj, [](Object* obj) { return CheckNull(obj); }, kIsNull, scope);
+Object* FIsNull(Object* const* args) {
+    return MakeBool(CheckNull(args[0]));
 }
 
-Object* FIsList(Object* obj, Object* scope) {
-    return FBoolFunctor(
-        obj, [](Object* obj) { return CheckProperList(obj); }, kIsList, scope);
+Object* FIsList(Object* const* args) {
+    return MakeBool(CheckProperList(args[0]));
 }
 
-Object* FCar(Object* obj, Object* scope) {
-    auto args = GetProperList(obj, kCar);
-    if (args.size() != 1) {
-        throw RuntimeError(kCar + kMustOneArg);
-    }
-    auto res = Eval(args[0], scope);
-    if (!Is<Cell>(res)) {
+Object* FCar(Object* const* args) {
+    if (!Is<Cell>(args[0])) {
         throw RuntimeError(kCar + kMustBeList);
     }
-    if (CheckNull(res)) {
+    if (CheckNull(args[0])) {
         throw RuntimeError(kCar + kMustNotNull);
     }
-    return As<Cell>(res)->GetFirst();
+    return As<Cell>(args[0])->GetFirst();
 }
 
-Object* FCdr(Object* obj, Object* scope) {
-    auto args = GetProperList(obj, kCdr);
-    if (args.size() != 1) {
-        throw RuntimeError(kCdr + kMustOneArg);
-    }
-    auto res = Eval(args[0], scope);
-    if (!Is<Cell>(res)) {
+Object* FCdr(Object* const* args) {
+    if (!Is<Cell>(args[0])) {
         throw RuntimeError(kCdr + kMustBeList);
     }
-    if (CheckNull(res)) {
+    if (CheckNull(args[0])) {
         throw RuntimeError(kCdr + kMustNotNull);
     }
-    return As<Cell>(res)->GetSecond();
+    return As<Cell>(args[0])->GetSecond();
 }
 
 // - other
-Object* FIsSymbol(Object* obj, Object* scope) {
-    return FBoolFunctor(
-        obj, [](Object* obj) { return Is<Symbol>(obj); }, kIsSymbol, scope);
+Object* FIsSymbol(Object* const* args) {
+    return MakeBool(Is<Symbol>(args[0]));
 }
 
 //   -- binary --
 
 // - number
-Object* FMonotone(Object* obj, std::function<bool(int64_t, int64_t)> comp,
-                  const std::string& context, Object* scope) {
-    auto args = GetProperList(obj, context);
+template <class Compare>
+Object* FMonotone(Object* obj, Compare comp, const std::string& context, Object* scope) {
+    ProperList args(obj, context);
     if (args.empty()) {
-        return Heap::GetHeap().Make<Bool>(true);
+        return MakeBool(true);
     }
-    auto last = Eval(args[0], scope);
-    if (!Is<Number>(last)) {
+    auto arg = args.begin();
+    auto first = Eval(*arg, scope);
+    if (!Is<Number>(first)) {
         throw RuntimeError(context + kMustBeNum);
     }
-    for (size_t id = 1; id < args.size(); ++id) {
-        auto cur = Eval(args[id], scope);
+    int64_t last = GetNumberValue(first);
+    while (++arg != args.end()) {
+        auto cur = Eval(*arg, scope);
         if (!Is<Number>(cur)) {
             throw RuntimeError(context + kMustBeNum);
         }
-        if (!comp(As<Number>(last)->GetValue(), As<Number>(cur)->GetValue())) {
-            return Heap::GetHeap().Make<Bool>(false);
+        if (!comp(last, GetNumberValue(cur))) {
+            return MakeBool(false);
         }
-        last = cur;
+        last = GetNumberValue(cur);
     }
-    return Heap::GetHeap().Make<Bool>(true);
+    return MakeBool(true);
 }
 
-Object* FBaseFunc(Object* obj, std::function<int64_t(int64_t, int64_t)> func, int64_t base,
-                  const std::string& context, Object* scope) {
-    auto args = GetProperList(obj, context);
+template <class Func>
+Object* FBaseFunc(Object* obj, Func func, int64_t base, const std::string& context,
+                  Object* scope) {
     int64_t last = base;
-    for (size_t id = 0; id < args.size(); ++id) {
-        auto tmp = Eval(args[id], scope);
+    for (Object* arg : ProperList(obj, context)) {
+        auto tmp = Eval(arg, scope);
         if (!Is<Number>(tmp)) {
             throw RuntimeError(context + kMustBeNum);
         }
-        last = func(last, As<Number>(tmp)->GetValue());
+        last = func(last, GetNumberValue(tmp));
     }
-    return Heap::GetHeap().Make<Number>(last);
+    return MakeNumber(last);
 }
 
-Object* FAtLeastOne(Object* obj, std::function<int64_t(int64_t, int64_t)> func,
-                    const std::string& context, Object* scope) {
-    auto args = GetProperList(obj, context);
+template <class Func>
+Object* FAtLeastOne(Object* obj, Func func, const std::string& context, Object* scope) {
+    ProperList args(obj, context);
     if (args.empty()) {
         throw RuntimeError(context + kMustOneMoreArg);
     }
-    auto cur = Eval(args[0], scope);
+    auto arg = args.begin();
+    auto cur = Eval(*arg, scope);
     if (!Is<Number>(cur)) {
         throw RuntimeError(context + kMustBeNum);
     }
-    int64_t last = As<Number>(cur)->GetValue();
+    int64_t last = GetNumberValue(cur);
     if (context == kMinus && args.size() == 1) {
-        return Heap::GetHeap().Make<Number>(-last);
+        return MakeNumber(-last);
     }
-    for (size_t id = 1; id < args.size(); ++id) {
-        auto tmp = Eval(args[id], scope);
+    while (++arg != args.end()) {
+        auto tmp = Eval(*arg, scope);
         if (!Is<Number>(tmp)) {
             throw RuntimeError(context + kMustBeNum);
         }
-        last = func(last, As<Number>(tmp)->GetValue());
+        last = func(last, GetNumberValue(tmp));
     }
-    return Heap::GetHeap().Make<Number>(last);
+    return MakeNumber(last);
 }
 
 Object* FEqual(Object* obj, Object* scope) {
@@ -252,15 +217,14 @@ Object* FMin(Object* obj, Object* scope) {
 }
 
 // - boolean
-Object* FBoolOp(Object* obj, std::function<bool(bool, bool)> func, bool base,
-                const std::string& context, Object* scope) {
-    auto args = GetProperList(obj, context);
-    Object* last = Heap::GetHeap().Make<Bool>(base);
-    for (size_t id = 0; id < args.size(); ++id) {
-        last = Eval(args[id], scope);
+template <class Func>
+Object* FBoolOp(Object* obj, Func func, bool base, const std::string& context, Object* scope) {
+    Object* last = MakeBool(base);
+    for (Object* arg : ProperList(obj, context)) {
+        last = Eval(arg, scope);
         bool cur = base;
         if (Is<Bool>(last)) {
-            cur = func(cur, As<Bool>(last)->GetValue());
+            cur = func(cur, GetBoolValue(last));
         }
         if (func(base, cur) != base) {
             break;
@@ -280,64 +244,69 @@ Object* FOr(Object* obj, Object* scope) {
 }
 
 // - list
-Object* FCons(Object* obj, Object* scope) {
-    auto args = GetProperList(obj, kCons);
-    if (args.size() != 2) {
-        throw RuntimeError(kCons + kMustTwoArg);
-    }
+Object* FCons(Object* const* args) {
     auto to_retern = Heap::GetHeap().Make<Cell>();
-    As<Cell>(to_retern)->SetFirst(Eval(args[0], scope));
-    As<Cell>(to_retern)->SetSecond(Eval(args[1], scope));
+    As<Cell>(to_retern)->SetFirst(args[0]);
+    As<Cell>(to_retern)->SetSecond(args[1]);
     return to_retern;
 }
 
 Object* FList(Object* obj, Object* scope) {
-    auto args = GetProperList(obj, kList);
+    ProperList args(obj, kList);
     if (args.empty()) {
         return nullptr;
     }
     auto to_retern = Heap::GetHeap().Make<Cell>();
-    As<Cell>(to_retern)->SetFirst(Eval(args[0], scope));
+    Root to_retern_root(to_retern);
+    auto arg = args.begin();
+    As<Cell>(to_retern)->SetFirst(Eval(*arg, scope));
     auto cur = to_retern;
-    for (size_t id = 1; id < args.size(); ++id) {
+    while (++arg != args.end()) {
         As<Cell>(cur)->SetSecond(Heap::GetHeap().Make<Cell>());
         cur = As<Cell>(cur)->GetSecond();
-        As<Cell>(cur)->SetFirst(Eval(args[id], scope));
+        As<Cell>(cur)->SetFirst(Eval(*arg, scope));
     }
     return to_retern;
 }
 
 Object* FListRef(Object* obj, Object* scope) {
-    auto args = GetProperList(obj, kListRef);
+    ProperList args(obj, kListRef);
     if (args.size() != 2) {
         throw RuntimeError(kCons + kMustTwoArg);
     }
-    auto list = GetProperList(Eval(args[0], scope), kListRef);
+    auto head = Eval(args[0], scope);
+    Root head_root(head);
+    ProperList list(head, kListRef);
     auto res = Eval(args[1], scope);
     if (!Is<Number>(res)) {
         throw RuntimeError(kListRef + kSMustBeNum);
     }
-    int64_t id = As<Number>(res)->GetValue();
+    int64_t id = GetNumberValue(res);
     if (id >= static_cast<int64_t>(list.size()) || id < 0) {
         throw RuntimeError(kListRef + kOutOfRange);
     }
-    return list[id];
+    // evaluating the index may have changed the list
+    while (id-- > 0) {
+        if (!Is<Cell>(head)) {
+            throw RuntimeError(kListRef + kOutOfRange);
+        }
+        head = As<Cell>(head)->GetSecond();
+    }
+    if (!Is<Cell>(head)) {
+        throw RuntimeError(kListRef + kOutOfRange);
+    }
+    return As<Cell>(head)->GetFirst();
 }
 
-Object* FListTail(Object* obj, Object* scope) {
-    auto args = GetProperList(obj, kListTail);
-    if (args.size() != 2) {
-        throw RuntimeError(kListTail + kMustTwoArg);
-    }
-    auto list = Eval(args[0], scope);
-    auto res = Eval(args[1], scope);
-    if (!Is<Number>(res)) {
+Object* FListTail(Object* const* args) {
+    if (!Is<Number>(args[1])) {
         throw RuntimeError(kListTail + kSMustBeNum);
     }
-    int64_t id = As<Number>(res)->GetValue();
+    int64_t id = GetNumberValue(args[1]);
     if (id < 0) {
         throw RuntimeError(kListTail + kOutOfRange);
     }
+    Object* list = args[0];
     while (id-- > 0) {
         if (!Is<Cell>(list)) {
             throw RuntimeError(kListTail + kOutOfRange);
@@ -4,9 +4,11 @@
 #include "object.h"
 #include "heap.h"
 
-#include <functional>
 #include <map>
 #include <memory>
+#include <string>
+#include <utility>
+#include <vector>
 
 namespace basics {
 
@@ -14,50 +16,41 @@ using Signature = Object*(Object*, Object*);
 
 // ---- functions ----
 
+// Special forms take the unevaluated arguments and the scope, primitives the evaluated arguments.
+
 //   -- unary --
-Object* FBoolFunctor(Object* obj, std::function<bool(Object*)> func, const std::string& context,
-                     Object* scope);
 
 // - special
 Object* FQuote(Object* obj, Object* scope);
 
 // - integer
-Object* FAbs(Object* obj, Object* scope);
+Object* FAbs(Object* const* args);
 
-Object* FIsNumber(Object* obj, Object* scope);
+Object* FIsNumber(Object* const* args);
 
 // - boolean
-Object* FIsBool(Object* obj, Object* scope);
+Object* FIsBool(Object* const* args);
 
-Object* FNot(Object* obj, Object* scope);
+Object* FNot(Object* const* args);
 
 // - list
-Object* FIsPair(Object* obj, Object* scope);
+Object* FIsPair(Object* const* args);
 
-Object* FIsNull(Object* obj, Object* scope);
+Object* FIsNull(Object* const* args);
 
-Object* FIsList(Object* obj, Object* scope);
+Object* FIsList(Object* const* args);
 
-Object* FCar(Object* obj, Object* scope);
+Object* FCar(Object* const* args);
 
-Object* FCdr(Object* obj, Object* scope);
+Object* FCdr(Object* const* args);
 
 // - other
 
-Object* FIsSymbol(Object* obj, Object* scope);
+Object* FIsSymbol(Object* const* args);
 
 //   -- binary --
 
 // - number
-Object* FMonotone(Object* obj, std::function<bool(int64_t, int64_t)> comp,
-                  const std::string& context, Object* scope);
-
-Object* FBaseFunc(Object* obj, std::function<int64_t(int64_t, int64_t)> func, int64_t base,
-                  const std::string& context, Object* scope);
-
-Object* FAtLeastOne(Object* obj, std::function<int64_t(int64_t, int64_t)> func,
-                    const std::string& context, Object* scope);
-
 Object* FEqual(Object* obj, Object* scope);
 
 Object* FLess(Object* obj, Object* scope);
@@ -81,51 +74,57 @@ Object* FMax(Object* obj, Object* scope);
 Object* FMin(Object* obj, Object* scope);
 
 // - boolean
-Object* FBoolOp(Object* obj, std::function<bool(bool, bool)> func, bool base,
-                const std::string& context, Object* scope);
-
 Object* FAnd(Object* obj, Object* scope);
 
 Object* FOr(Object* obj, Object* scope);
 
 // - list
-Object* FCons(Object* obj, Object* scope);
+Object* FCons(Object* const* args);
 
 Object* FList(Object* obj, Object* scope);
 
 Object* FListRef(Object* obj, Object* scope);
 
-Object* FListTail(Object* obj, Object* scope);
+Object* FListTail(Object* const* args);
 
 }  // namespace basics
 
-const std::vector<std::pair<std::string, Object*>> kBasicFunctions = {
-    {kQuote, Heap::GetHeap().Make<Reserved>(kQuote, basics::FQuote)},
-    {kAbs, Heap::GetHeap().Make<Reserved>(kAbs, basics::FAbs)},
-    {kIsNumber, Heap::GetHeap().Make<Reserved>(kIsNumber, basics::FIsNumber)},
-    {kIsBool, Heap::GetHeap().Make<Reserved>(kIsBool, basics::FIsBool)},
-    {kNot, Heap::GetHeap().Make<Reserved>(kNot, basics::FNot)},
-    {kIsPair, Heap::GetHeap().Make<Reserved>(kIsPair, basics::FIsPair)},
-    {kIsNull, Heap::GetHeap().Make<Reserved>(kIsNull, basics::FIsNull)},
-    {kIsList, Heap::GetHeap().Make<Reserved>(kIsList, basics::FIsList)},
-    {kCar, Heap::GetHeap().Make<Reserved>(kCar, basics::FCar)},
-    {kCdr, Heap::GetHeap().Make<Reserved>(kCdr, basics::FCdr)},
-    {kIsSymbol, Heap::GetHeap().Make<Reserved>(kIsSymbol, basics::FIsSymbol)},
-    {kEqual, Heap::GetHeap().Make<Reserved>(kEqual, basics::FEqual)},
-    {kLess, Heap::GetHeap().Make<Reserved>(kLess, basics::FLess)},
-    {kGreater, Heap::GetHeap().Make<Reserved>(kGreater, basics::FGreater)},
-    {kLEqual, Heap::GetHeap().Make<Reserved>(kLEqual, basics::FLEqual)},
-    {kGEqual, Heap::GetHeap().Make<Reserved>(kGEqual, basics::FGEqual)},
-    {kPlus, Heap::GetHeap().Make<Reserved>(kPlus, basics::FPlus)},
-    {kMultiply, Heap::GetHeap().Make<Reserved>(kMultiply, basics::FMultiply)},
-    {kMinus, Heap::GetHeap().Make<Reserved>(kMinus, basics::FMinus)},
-    {kDivide, Heap::GetHeap().Make<Reserved>(kDivide, basics::FDivide)},
-    {kMax, Heap::GetHeap().Make<Reserved>(kMax, basics::FMax)},
-    {kMin, Heap::GetHeap().Make<Reserved>(kMin, basics::FMin)},
-    {kAnd, Heap::GetHeap().Make<Reserved>(kAnd, basics::FAnd)},
-    {kOr, Heap::GetHeap().Make<Reserved>(kOr, basics::FOr)},
-    {kCons, Heap::GetHeap().Make<Reserved>(kCons, basics::FCons)},
-    {kList, Heap::GetHeap().Make<Reserved>(kList, basics::FList)},
-    {kListRef, Heap::GetHeap().Make<Reserved>(kListRef, basics::FListRef)},
-    {kListTail, Heap::GetHeap().Make<Reserved>(kListTail, basics::FListTail)},
+// the argument evaluation order of the variadic builtins and list-ref is observable through
+// their errors, so they stay special forms
+inline const std::vector<std::pair<std::string, Object*>> kBasicFunctions = {
+    {kQuote, Heap::GetHeap().MakePermanent<Reserved>(kQuote, basics::FQuote, 1, 1)},
+    {kAbs, Heap::GetHeap().MakePermanent<Reserved>(kAbs, basics::FAbs, 1)},
+    {kIsNumber, Heap::GetHeap().MakePermanent<Reserved>(kIsNumber, basics::FIsNumber, 1)},
+    {kIsBool, Heap::GetHeap().MakePermanent<Reserved>(kIsBool, basics::FIsBool, 1)},
+    {kNot, Heap::GetHeap().MakePermanent<Reserved>(kNot, basics::FNot, 1)},
+    {kIsPair, Heap::GetHeap().MakePermanent<Reserved>(kIsPair, basics::FIsPair, 1)},
+    {kIsNull, Heap::GetHeap().MakePermanent<Reserved>(kIsNull, basics::FIsNull, 1)},
+    {kIsList, Heap::GetHeap().MakePermanent<Reserved>(kIsList, basics::FIsList, 1)},
+    {kCar, Heap::GetHeap().MakePermanent<Reserved>(kCar, basics::FCar, 1)},
+    {kCdr, Heap::GetHeap().MakePermanent<Reserved>(kCdr, basics::FCdr, 1)},
+    {kIsSymbol, Heap::GetHeap().MakePermanent<Reserved>(kIsSymbol, basics::FIsSymbol, 1)},
+    {kEqual,
+     Heap::GetHeap().MakePermanent<Reserved>(kEqual, basics::FEqual, 0, Reserved::kVariadic)},
+    {kLess, Heap::GetHeap().MakePermanent<Reserved>(kLess, basics::FLess, 0, Reserved::kVariadic)},
+    {kGreater,
+     Heap::GetHeap().MakePermanent<Reserved>(kGreater, basics::FGreater, 0, Reserved::kVariadic)},
+    {kLEqual,
+     Heap::GetHeap().MakePermanent<Reserved>(kLEqual, basics::FLEqual, 0, Reserved::kVariadic)},
+    {kGEqual,
+     Heap::GetHeap().MakePermanent<Reserved>(kGEqual, basics::FGEqual, 0, Reserved::kVariadic)},
+    {kPlus, Heap::GetHeap().MakePermanent<Reserved>(kPlus, basics::FPlus, 0, Reserved::kVariadic)},
+    {kMultiply,
+     Heap::GetHeap().MakePermanent<Reserved>(kMultiply, basics::FMultiply, 0, Reserved::kVariadic)},
+    {kMinus,
+     Heap::GetHeap().MakePermanent<Reserved>(kMinus, basics::FMinus, 1, Reserved::kVariadic)},
+    {kDivide,
+     Heap::GetHeap().MakePermanent<Reserved>(kDivide, basics::FDivide, 1, Reserved::kVariadic)},
+    {kMax, Heap::GetHeap().MakePermanent<Reserved>(kMax, basics::FMax, 1, Reserved::kVariadic)},
+    {kMin, Heap::GetHeap().MakePermanent<Reserved>(kMin, basics::FMin, 1, Reserved::kVariadic)},
+    {kAnd, Heap::GetHeap().MakePermanent<Reserved>(kAnd, basics::FAnd, 0, Reserved::kVariadic)},
+    {kOr, Heap::GetHeap().MakePermanent<Reserved>(kOr, basics::FOr, 0, Reserved::kVariadic)},
+    {kCons, Heap::GetHeap().MakePermanent<Reserved>(kCons, basics::FCons, 2)},
+    {kList, Heap::GetHeap().MakePermanent<Reserved>(kList, basics::FList, 0, Reserved::kVariadic)},
+    {kListRef, Heap::GetHeap().MakePermanent<Reserved>(kListRef, basics::FListRef, 2, 2)},
+    {kListTail, Heap::GetHeap().MakePermanent<Reserved>(kListTail, basics::FListTail, 2)},
 };
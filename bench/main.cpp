@@ -0,0 +1,390 @@
+#include "analyzer.h"
+#include "heap.h"
+#include "jit.h"
+#include "scheme.h"
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Runs scheme workloads and reports time, allocation throughput and, when the kernel allows it,
+// hardware cache misses. Workloads without a `run` expression time full collections of the heap
+// built by their setup. Pause percentiles are upper bounds of the heap pause histogram buckets.
+// Frames of lambda calls taken from the frame pool are not allocations, they are counted apart.
+// The JIT is off unless a workload asks for it.
+// Usage: scheme_bench [workload-name]
+
+struct Workload {
+    std::string name;
+    std::vector<std::string> setup;
+    std::string run;
+    size_t repeat;
+    // incremental marking slice budget, 0 for stop-the-world full collections
+    size_t slice_budget = 0;
+    // the workload runs once per thread count given to the heap
+    std::vector<size_t> threads = {1};
+    // evacuate the young generation at the end of every run
+    bool copying = false;
+    // the workload runs once per evaluator, bytecode runs are suffixed with /bc
+    std::vector<Evaluator> evaluators = {Evaluator::kTree};
+    // the workload runs once per JIT threshold, runs with the JIT on are suffixed with /jit
+    std::vector<size_t> jit_thresholds = {0};
+};
+
+const std::vector<Evaluator> kBothEvaluators = {Evaluator::kTree, Evaluator::kBytecode};
+const std::vector<size_t> kWithJit = {0, Jit::kDefaultThreshold};
+
+std::vector<std::string> Repeat(std::vector<std::string> lines, const std::string& line,
+                                size_t count) {
+    for (size_t id = 0; id < count; ++id) {
+        lines.push_back(line);
+    }
+    return lines;
+}
+
+const std::vector<Workload> kWorkloads = {
+    {"cons-list",
+     {"(define (range n acc) (if (= n 0) acc (range (- n 1) (cons n acc))))"},
+     "(range 5000 '())",
+     200,
+     0,
+     {1},
+     false,
+     kBothEvaluators},
+    {"list-walk",
+     {"(define (range n acc) (if (= n 0) acc (range (- n 1) (cons n acc))))",
+      "(define (sum l acc) (if (null? l) acc (sum (cdr l) (+ acc (car l)))))",
+      "(define big (range 5000 '()))"},
+     "(sum big 0)",
+     200,
+     0,
+     {1},
+     false,
+     kBothEvaluators},
+    {"list-build",
+     {"(define (mk n) (if (= n 0) '() (cons (list n n n) (mk (- n 1)))))"},
+     "(mk 2000)",
+     200},
+    {"closures",
+     {"(define (adders n) (if (= n 0) '() (cons (lambda (x) (+ x n)) (adders (- n 1)))))"},
+     "(adders 2000)",
+     200,
+     0,
+     {1},
+     false,
+     kBothEvaluators},
+    {"closure-retain",
+     Repeat({"(define (range n acc) (if (= n 0) acc (range (- n 1) (cons n acc))))",
+             "(define (make n) (define junk (range 200 '())) (lambda () n))",
+             "(define (makes n acc) (if (= n 0) acc (makes (- n 1) (cons (make n) acc))))",
+             "(define fns '())"},
+            "(set! fns (cons (makes 500 '()) fns))", 10),
+     "",
+     50},
+    {"fib",
+     {"(define (fib n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))"},
+     "(fib 18)",
+     20,
+     0,
+     {1},
+     false,
+     kBothEvaluators,
+     kWithJit},
+    {"tak",
+     {"(define (tak x y z) (if (< y x) (tak (tak (- x 1) y z) (tak (- y 1) z x) "
+      "(tak (- z 1) x y)) z))"},
+     "(tak 18 12 6)",
+     5,
+     0,
+     {1},
+     false,
+     kBothEvaluators,
+     kWithJit},
+    {"sum-loop",
+     {"(define (sum n acc) (if (= n 0) acc (sum (- n 1) (+ acc n))))"},
+     "(sum 100000 0)",
+     20,
+     0,
+     {1},
+     false,
+     kBothEvaluators,
+     kWithJit},
+    {"countdown",
+     {"(define (count n) (if (= n 0) 0 (count (- n 1))))"},
+     "(count 5000)",
+     200,
+     0,
+     {1},
+     false,
+     kBothEvaluators},
+    {"deep",
+     {"(define (deep n) (if (= n 0) 0 (+ 1 (deep (- n 1)))))"},
+     "(deep 4000)",
+     200,
+     0,
+     {1},
+     false,
+     kBothEvaluators},
+    {"locals",
+     {"(define (rot n a b c d) (if (= n 0) (+ a b c d) (rot (- n 1) b c d ((lambda () a)))))"},
+     "(rot 5000 1 2 3 4)",
+     100,
+     0,
+     {1},
+     false,
+     kBothEvaluators},
+    {"fold",
+     {"(define (secs n acc) (if (= n 0) acc (secs (- n 1) (+ acc (* (* 60 60) 24)))))"},
+     "(secs 5000 0)",
+     100,
+     0,
+     {1},
+     false,
+     kBothEvaluators},
+    {"arith",
+     {"(define x 7)"},
+     "(+ (* x 4) (- 10 (/ 9 3)) (max 1 x 3) (min 4 5) (abs -7) (if (< 1 x 9) 1 0))",
+     100000,
+     0,
+     {1},
+     false,
+     kBothEvaluators},
+    {"churn",
+     {"(define (junk n acc) (if (= n 0) acc (junk (- n 1) (cons n acc))))",
+      "(define (churn n) (junk 200 '()) (if (= n 0) 0 (churn (- n 1))))"},
+     "(churn 5000)",
+     5},
+    {"pauses",
+     Repeat({"(define (push n acc) (if (= n 0) acc (push (- n 1) (cons n acc))))",
+             "(define big '())", "(define tmp '())"},
+            "(set! big (push 1000 big))", 500),
+     "(set! tmp (push 5000 '()))",
+     200},
+    {"pauses-incr",
+     Repeat({"(define (push n acc) (if (= n 0) acc (push (- n 1) (cons n acc))))",
+             "(define big '())", "(define tmp '())"},
+            "(set! big (push 1000 big))", 500),
+     "(set! tmp (push 5000 '()))",
+     200,
+     4096},
+    {"gc-long-list",
+     Repeat({"(define (push n acc) (if (= n 0) acc (push (- n 1) (cons n acc))))",
+             "(define big '())"},
+            "(set! big (push 1000 big))", 200),
+     "",
+     50},
+    {"gc-deep-scopes",
+     Repeat({"(define (chain n k) (if (= n 0) k (chain (- n 1) (lambda () k))))",
+             "(define c 0)"},
+            "(set! c (chain 1000 c))", 100),
+     "",
+     50},
+    {"walk-scattered",
+     Repeat({"(define (grow n acc) (if (= n 0) acc (grow (- n 1) (cons n (cdr (cons 0 acc))))))",
+             "(define big '())"},
+            "(set! big (grow 2000 big))", 100),
+     "(list-tail big 200000)",
+     200},
+    {"walk-copied",
+     Repeat({"(define (grow n acc) (if (= n 0) acc (grow (- n 1) (cons n (cdr (cons 0 acc))))))",
+             "(define big '())"},
+            "(set! big (grow 2000 big))", 100),
+     "(list-tail big 200000)",
+     200,
+     0,
+     {1},
+     true},
+    {"mark-lists",
+     Repeat({"(define (push n acc) (if (= n 0) acc (push (- n 1) (cons n acc))))",
+             "(define lists '())"},
+            "(set! lists (cons (push 1000 '()) lists))", 500),
+     "",
+     20,
+     0,
+     {1, 2, 4, 8}},
+    {"mark-closures",
+     Repeat({"(define (adders n) (if (= n 0) '() (cons (lambda (x) (+ x n)) (adders (- n 1)))))",
+             "(define fns '())"},
+            "(set! fns (cons (adders 2000) fns))", 100),
+     "",
+     20,
+     0,
+     {1, 2, 4, 8}},
+};
+
+class CacheMissCounter {
+public:
+    CacheMissCounter() {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd_ = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+
+    ~CacheMissCounter() {
+        if (fd_ >= 0) {
+            close(fd_);
+        }
+    }
+
+    bool IsAvailable() const {
+        return fd_ >= 0;
+    }
+
+    void Start() {
+        if (fd_ >= 0) {
+            ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+
+    uint64_t Stop() {
+        uint64_t count = 0;
+        if (fd_ >= 0) {
+            ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(fd_, &count, sizeof(count)) != sizeof(count)) {
+                count = 0;
+            }
+        }
+        return count;
+    }
+
+private:
+    long fd_;
+};
+
+// peak resident set size of the process in KiB
+size_t GetPeakMemory() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.rfind("VmHWM:", 0) == 0) {
+            return std::stoul(line.substr(6));
+        }
+    }
+    return 0;
+}
+
+// upper bound in microseconds of the pause histogram bucket reached by the given share of pauses
+size_t GetPausePercentile(const std::array<size_t, Heap::kPauseBuckets>& histogram,
+                          double share) {
+    size_t total = 0;
+    for (const auto& count : histogram) {
+        total += count;
+    }
+    size_t seen = 0;
+    for (size_t bucket = 0; bucket < histogram.size(); ++bucket) {
+        seen += histogram[bucket];
+        if (seen && seen >= share * total) {
+            return size_t(1) << bucket;
+        }
+    }
+    return 0;
+}
+
+void RunWorkload(const Workload& workload, size_t threads, Evaluator evaluator,
+                 size_t jit_threshold, CacheMissCounter& counter) {
+    auto& heap = Heap::GetHeap();
+    heap.SetSliceBudget(workload.slice_budget);
+    heap.SetThreadCount(threads);
+    heap.SetCopying(workload.copying);
+    SiteStats sites = GetSiteStats();
+    JitStats jit = Jit::GetStats();
+    Interpreter scheme(evaluator);
+    scheme.SetJitThreshold(jit_threshold);
+    for (const auto& line : workload.setup) {
+        scheme.Run(line);
+    }
+    auto pauses = heap.GetStats().pause_histogram;
+    size_t allocations = heap.GetStats().allocations;
+    size_t reused_frames = heap.GetStats().reused_frames;
+    counter.Start();
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t id = 0; id < workload.repeat; ++id) {
+        if (workload.run.empty()) {
+            heap.MarkAndSweep();
+        } else {
+            scheme.Run(workload.run);
+        }
+    }
+    const auto end = std::chrono::steady_clock::now();
+    uint64_t misses = counter.Stop();
+    allocations = heap.GetStats().allocations - allocations;
+    reused_frames = heap.GetStats().reused_frames - reused_frames;
+    for (size_t bucket = 0; bucket < pauses.size(); ++bucket) {
+        pauses[bucket] = heap.GetStats().pause_histogram[bucket] - pauses[bucket];
+    }
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+    std::string name = workload.name;
+    if (workload.threads.size() > 1) {
+        name += "/" + std::to_string(threads);
+    }
+    if (evaluator == Evaluator::kBytecode) {
+        name += "/bc";
+    }
+    if (jit_threshold) {
+        name += "/jit";
+    }
+    std::cout << std::left << std::setw(16) << name << std::right << std::fixed
+              << std::setprecision(1) << std::setw(10) << seconds * 1000 << " ms"
+              << std::setw(12) << allocations / seconds / 1e6 << " M allocs/s" << std::setw(10)
+              << allocations / workload.repeat << " allocs/run" << std::setw(10)
+              << reused_frames / workload.repeat << " reused/run";
+    if (counter.IsAvailable()) {
+        std::cout << std::setw(14) << misses << " cache-misses";
+    } else {
+        std::cout << "    cache-misses n/a";
+    }
+    std::cout << std::setw(8) << heap.GetStats().slabs << " slabs" << std::setw(10)
+              << GetPeakMemory() << " KiB peak" << std::setw(8)
+              << GetPausePercentile(pauses, 0.99) << " us p99 pause" << std::setw(8) << GetPausePercentile(pauses, 1) << " us max";
+    if (evaluator == Evaluator::kTree) {
+        const auto& now = GetSiteStats();
+        std::cout << std::setw(6) << now.specialized - sites.specialized << "/"
+                  << now.sites - sites.sites << " sites fixnum, "
+                  << now.deoptimized - sites.deoptimized << " deopt";
+    }
+    if (jit_threshold) {
+        const auto& now = Jit::GetStats();
+        std::cout << std::setw(4) << now.compiled - jit.compiled << " jitted, "
+                  << now.rejected - jit.rejected << " rejected, " << now.bailouts - jit.bailouts
+                  << " bailouts";
+    }
+    std::cout << "\n";
+    heap.SetSliceBudget(0);
+    heap.SetThreadCount(1);
+    heap.SetCopying(false);
+}
+
+int main(int argc, char** argv) {
+    CacheMissCounter counter;
+    for (const auto& workload : kWorkloads) {
+        if (argc > 1 && workload.name != argv[1]) {
+            continue;
+        }
+        for (const auto& evaluator : workload.evaluators) {
+            for (const auto& threads : workload.threads) {
+                for (const auto& jit_threshold : workload.jit_thresholds) {
+                    RunWorkload(workload, threads, evaluator, jit_threshold, counter);
+                }
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,454 @@
+#include "compiler.h"
+
+#include "advanced.h"
+#include "assertions.h"
+#include "basics.h"
+#include "folder.h"
+#include "constants.h"
+#include "heap.h"
+#include "helpers.h"
+#include "object.h"
+#include "scheme.h"
+#include "scope.h"
+#include "symbol_table.h"
+
+#include <new>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+enum class Builtin : uint8_t {
+    kIf,
+    kQuote,
+    kPlus,
+    kMultiply,
+    kMinus,
+    kDivide,
+    kMax,
+    kMin,
+    kEqual,
+    kLess,
+    kGreater,
+    kLEqual,
+    kGEqual,
+    kAnd,
+    kOr,
+    kCar,
+    kCdr,
+    kCons,
+    kList,
+    kIsNull,
+    kNot,
+};
+
+namespace {
+
+// inlined builtins by the ids of their names
+const std::unordered_map<uint32_t, Builtin>& GetBuiltins() {
+    static const std::unordered_map<uint32_t, Builtin> builtins = [] {
+        const std::vector<std::pair<std::string, Builtin>> names = {
+            {kIf, Builtin::kIf},         {kQuote, Builtin::kQuote},
+            {kPlus, Builtin::kPlus},     {kMultiply, Builtin::kMultiply},
+            {kMinus, Builtin::kMinus},   {kDivide, Builtin::kDivide},
+            {kMax, Builtin::kMax},       {kMin, Builtin::kMin},
+            {kEqual, Builtin::kEqual},   {kLess, Builtin::kLess},
+            {kGreater, Builtin::kGreater}, {kLEqual, Builtin::kLEqual},
+            {kGEqual, Builtin::kGEqual}, {kAnd, Builtin::kAnd},
+            {kOr, Builtin::kOr},         {kCar, Builtin::kCar},
+            {kCdr, Builtin::kCdr},       {kCons, Builtin::kCons},
+            {kList, Builtin::kList},     {kIsNull, Builtin::kIsNull},
+            {kNot, Builtin::kNot},
+        };
+        std::unordered_map<uint32_t, Builtin> builtins;
+        for (const auto& [name, builtin] : names) {
+            builtins[SymbolTable::Get().GetId(name)] = builtin;
+        }
+        return builtins;
+    }();
+    return builtins;
+}
+
+}  // namespace
+
+Code::Code(std::vector<uint32_t> ops, std::vector<Object*> constants)
+    : Object(ObjectType::kCode), ops_(std::move(ops)), constants_(std::move(constants)) {
+    for (const auto& obj : constants_) {
+        Heap::GetHeap().WriteBarrier(this, obj);
+    }
+}
+
+void Code::Trace(Tracer& tracer) {
+    for (auto& obj : constants_) {
+        tracer.Visit(obj);
+    }
+}
+
+Object* Code::MoveTo(void* slot) {
+    return new (slot) Code(std::move(*this));
+}
+
+Object* Compiler::CompileExpression(Object* obj) {
+    Compiler compiler;
+    RootList constants_root(compiler.constants_);
+    compiler.Compile(obj, true);
+    compiler.Emit(Op::kReturn);
+    return compiler.Finish();
+}
+
+Object* Compiler::CompileBody(Object* body, Object* scope) {
+    if (!CheckProperList(body)) {
+        return nullptr;
+    }
+    Compiler compiler;
+    compiler.scope_ = scope;
+    RootList constants_root(compiler.constants_);
+    for (Object* form = body; form; form = As<Cell>(form)->GetSecond()) {
+        if (form != body) {
+            compiler.Emit(Op::kPop);
+        }
+        compiler.Compile(As<Cell>(form)->GetFirst(), !As<Cell>(form)->GetSecond());
+    }
+    compiler.Emit(Op::kReturn);
+    return compiler.Finish();
+}
+
+void Compiler::Compile(Object* obj, bool tail) {
+    if (!obj) {
+        Emit(Op::kEvalEmpty);
+        return;
+    }
+    switch (GetObjectType(obj)) {
+        case ObjectType::kNumber:
+        case ObjectType::kBool:
+            Emit(Op::kConst);
+            Emit(AddConstant(obj));
+            return;
+        case ObjectType::kDot:
+            Emit(Op::kEvalDot);
+            return;
+        case ObjectType::kFrameLayout:
+            Compile(static_cast<FrameLayout*>(obj)->GetParams(), tail);
+            return;
+        case ObjectType::kLocalSymbol: {
+            auto local = static_cast<LocalSymbol*>(obj);
+            Emit(Op::kLoadLocal);
+            Emit(local->GetDepth());
+            Emit(local->GetSlot());
+            Emit(local->GetId());
+            return;
+        }
+        case ObjectType::kGlobalSymbol:
+            Emit(Op::kLoadGlobal);
+            Emit(AddConstant(obj));
+            return;
+        case ObjectType::kSymbol:
+        case ObjectType::kLambda:
+        case ObjectType::kReserved:
+            Emit(Op::kLoadName);
+            Emit(static_cast<Symbol*>(obj)->GetId());
+            return;
+        default:
+            ASSERT(Is<Cell>(obj), "Unknown Object");
+    }
+    CompileCall(static_cast<Cell*>(obj), tail);
+}
+
+bool Compiler::CompileFolded(Cell* form, bool tail) {
+    static Object* const kIfBuiltin = FindBuiltin(SymbolTable::Get().GetId(kIf));
+    size_t epoch = Scope::GetBuiltinEpoch();
+    Object* value;
+    Object* branch = nullptr;
+    bool constant = FoldConstant(form, scope_, value);
+    if (!constant) {
+        if (FoldBuiltin(form->GetFirst(), scope_) != kIfBuiltin) {
+            return false;
+        }
+        ProperList args(form->GetSecond());
+        if (args.size() != 2 && args.size() != 3) {
+            return false;
+        }
+        if (!FoldConstant(args[0], scope_, value)) {
+            return false;
+        }
+        if (!Is<Bool>(value) || GetBoolValue(value)) {
+            branch = args[1];
+        } else if (args.size() == 3) {
+            branch = args[2];
+        } else {
+            constant = true;
+            value = nullptr;
+        }
+    }
+    Emit(Op::kCheckEpoch);
+    Emit(AddConstant(MakeNumber(epoch)));
+    size_t unfolded = EmitTarget();
+    if (constant) {
+        Emit(Op::kConst);
+        Emit(AddConstant(value));
+    } else {
+        Compile(branch, tail);
+    }
+    Emit(Op::kJump);
+    size_t end = EmitTarget();
+    Bind(unfolded);
+    // runs only once every fold is invalid
+    fold_ = false;
+    CompileCall(form, tail);
+    fold_ = true;
+    Bind(end);
+    return true;
+}
+
+void Compiler::CompileCall(Cell* form, bool tail) {
+    if (scope_ && fold_ && CheckProperList(form->GetSecond()) && CompileFolded(form, tail)) {
+        return;
+    }
+    Compile(form->GetFirst());
+    Object* args_list = form->GetSecond();
+    if (!CheckProperList(args_list)) {
+        // every function rejects an improper argument list, Function::Call raises its error
+        Emit(Op::kCallFunction);
+        Emit(AddConstant(args_list));
+        return;
+    }
+    auto args = GetProperList(args_list);
+
+    size_t end = 0;
+    auto head = As<Symbol>(form->GetFirst());
+    auto builtin = head ? As<Reserved>(FindBuiltin(head->GetId())) : nullptr;
+    if (builtin && builtin->Accepts(args.size())) {
+        const auto& builtins = GetBuiltins();
+        auto it = builtins.find(head->GetId());
+        if (it != builtins.end() || builtin->GetPrimitive()) {
+            Emit(Op::kGuard);
+            Emit(AddConstant(builtin));
+            size_t generic = EmitTarget();
+            if (it != builtins.end()) {
+                CompileBuiltin(it->second, args, tail);
+            } else {
+                for (const auto& arg : args) {
+                    Compile(arg);
+                }
+                Emit(Op::kCallPrimitive);
+                Emit(AddConstant(builtin));
+                Emit(static_cast<uint32_t>(args.size()));
+            }
+            Emit(Op::kJump);
+            end = EmitTarget();
+            Bind(generic);
+        }
+    }
+
+    Emit(Op::kPrepareCall);
+    Emit(static_cast<uint32_t>(args.size()));
+    Emit(AddConstant(args_list));
+    size_t called = EmitTarget();
+    for (const auto& arg : args) {
+        Compile(arg);
+    }
+    Emit(tail ? Op::kTailCall : Op::kCall);
+    Emit(static_cast<uint32_t>(args.size()));
+    Bind(called);
+    if (end) {
+        Bind(end);
+    }
+}
+
+void Compiler::CompileBuiltin(Builtin builtin, const std::vector<Object*>& args, bool tail) {
+    switch (builtin) {
+        case Builtin::kIf: {
+            Compile(args[0]);
+            Emit(Op::kJumpIfFalse);
+            size_t otherwise = EmitTarget();
+            Compile(args[1], tail);
+            Emit(Op::kJump);
+            size_t end = EmitTarget();
+            Bind(otherwise);
+            if (args.size() == 3) {
+                Compile(args[2], tail);
+            } else {
+                Emit(Op::kConst);
+                Emit(AddConstant(nullptr));
+            }
+            Bind(end);
+            return;
+        }
+        case Builtin::kQuote:
+            Emit(Op::kConst);
+            Emit(AddConstant(args[0]));
+            return;
+        case Builtin::kPlus:
+            CompileFold(Op::kAdd, args, MakeNumber(0));
+            return;
+        case Builtin::kMultiply:
+            CompileFold(Op::kMultiply, args, MakeNumber(1));
+            return;
+        case Builtin::kMinus:
+            CompileFold(Op::kSubtract, args, nullptr);
+            if (args.size() == 1) {
+                Emit(Op::kNegate);
+            }
+            return;
+        case Builtin::kDivide:
+            CompileFold(Op::kDivide, args, nullptr);
+            return;
+        case Builtin::kMax:
+            CompileFold(Op::kMax, args, nullptr);
+            return;
+        case Builtin::kMin:
+            CompileFold(Op::kMin, args, nullptr);
+            return;
+        case Builtin::kEqual:
+            CompileCompare(Op::kEqual, args);
+            return;
+        case Builtin::kLess:
+            CompileCompare(Op::kLess, args);
+            return;
+        case Builtin::kGreater:
+            CompileCompare(Op::kGreater, args);
+            return;
+        case Builtin::kLEqual:
+            CompileCompare(Op::kLessEqual, args);
+            return;
+        case Builtin::kGEqual:
+            CompileCompare(Op::kGreaterEqual, args);
+            return;
+        case Builtin::kAnd:
+            CompileBoolOp(false, args, tail);
+            return;
+        case Builtin::kOr:
+            CompileBoolOp(true, args, tail);
+            return;
+        case Builtin::kCar:
+            Compile(args[0]);
+            Emit(Op::kCar);
+            return;
+        case Builtin::kCdr:
+            Compile(args[0]);
+            Emit(Op::kCdr);
+            return;
+        case Builtin::kCons:
+            Compile(args[0]);
+            Compile(args[1]);
+            Emit(Op::kCons);
+            return;
+        case Builtin::kList:
+            if (args.empty()) {
+                Emit(Op::kConst);
+                Emit(AddConstant(nullptr));
+                return;
+            }
+            for (const auto& arg : args) {
+                Compile(arg);
+            }
+            Emit(Op::kList);
+            Emit(static_cast<uint32_t>(args.size()));
+            return;
+        case Builtin::kIsNull:
+            Compile(args[0]);
+            Emit(Op::kIsNull);
+            return;
+        case Builtin::kNot:
+            Compile(args[0]);
+            Emit(Op::kNot);
+            return;
+    }
+}
+
+void Compiler::CompileFold(Op op, const std::vector<Object*>& args, Object* empty) {
+    // the builtins check every argument right after evaluating it
+    if (args.empty()) {
+        Emit(Op::kConst);
+        Emit(AddConstant(empty));
+        return;
+    }
+    Compile(args[0]);
+    Emit(Op::kCheckNumber);
+    Emit(static_cast<uint32_t>(op));
+    for (size_t id = 1; id < args.size(); ++id) {
+        Compile(args[id]);
+        Emit(op);
+    }
+}
+
+void Compiler::CompileCompare(Op op, const std::vector<Object*>& args) {
+    if (args.empty()) {
+        Emit(Op::kConst);
+        Emit(AddConstant(MakeBool(true)));
+        return;
+    }
+    Compile(args[0]);
+    Emit(Op::kCheckNumber);
+    Emit(static_cast<uint32_t>(op));
+    if (args.size() == 2) {
+        Compile(args[1]);
+        Emit(op);
+        Emit(0u);
+        return;
+    }
+    // the comparison stops at the first pair out of order, later arguments are not evaluated
+    std::vector<size_t> fails;
+    for (size_t id = 1; id < args.size(); ++id) {
+        Compile(args[id]);
+        Emit(op);
+        fails.push_back(EmitTarget());
+    }
+    Emit(Op::kPop);
+    Emit(Op::kConst);
+    Emit(AddConstant(MakeBool(true)));
+    Emit(Op::kJump);
+    size_t end = EmitTarget();
+    for (const auto& fail : fails) {
+        Bind(fail);
+    }
+    Emit(Op::kConst);
+    Emit(AddConstant(MakeBool(false)));
+    Bind(end);
+}
+
+void Compiler::CompileBoolOp(bool stop_value, const std::vector<Object*>& args, bool tail) {
+    if (args.empty()) {
+        Emit(Op::kConst);
+        Emit(AddConstant(MakeBool(!stop_value)));
+        return;
+    }
+    std::vector<size_t> stops;
+    for (size_t id = 0; id < args.size(); ++id) {
+        Compile(args[id], tail && id + 1 == args.size());
+        if (id + 1 < args.size()) {
+            Emit(Op::kJumpIfBool);
+            Emit(static_cast<uint32_t>(stop_value));
+            stops.push_back(EmitTarget());
+        }
+    }
+    for (const auto& stop : stops) {
+        Bind(stop);
+    }
+}
+
+void Compiler::Emit(Op op) {
+    ops_.push_back(static_cast<uint32_t>(op));
+}
+
+void Compiler::Emit(uint32_t operand) {
+    ops_.push_back(operand);
+}
+
+uint32_t Compiler::AddConstant(Object* obj) {
+    constants_.push_back(obj);
+    return constants_.size() - 1;
+}
+
+size_t Compiler::EmitTarget() {
+    ops_.push_back(0);
+    return ops_.size() - 1;
+}
+
+void Compiler::Bind(size_t target) {
+    ops_[target] = ops_.size();
+}
+
+Object* Compiler::Finish() {
+    return Heap::GetHeap().Make<Code>(std::move(ops_), std::move(constants_));
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include "object.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Instructions of the bytecode run by the VM. Operands follow the opcode in the same stream,
+// jump targets are offsets from the start of the code.
+enum class Op : uint32_t {
+    // constant: pushes the constant
+    kConst,
+    // depth slot name: pushes the value of a LocalSymbol
+    kLoadLocal,
+    // constant: pushes the value of the GlobalSymbol
+    kLoadGlobal,
+    // name: pushes the value of the variable looked up by name
+    kLoadName,
+    // throw the errors of evaluating the empty list and a dot
+    kEvalEmpty,
+    kEvalDot,
+    kPop,
+    // target
+    kJump,
+    // target: pops the value, jumps if it is #f
+    kJumpIfFalse,
+    // value target: jumps keeping the value on top if it is the boolean `value`, pops it otherwise
+    kJumpIfBool,
+    // constant target: pops the function on top if it is the constant builtin, otherwise jumps
+    // keeping it
+    kGuard,
+    // constant target: jumps to the unfolded code unless Scope::GetBuiltinEpoch() is still the
+    // fixnum constant
+    kCheckEpoch,
+    // argc constant target: checks the function on top before its arguments are evaluated.
+    // A lambda stays on the stack, any other function is called with the unevaluated arguments
+    // in the constant and replaced with the result before the jump
+    kPrepareCall,
+    // argc: calls the lambda below the arguments
+    kCall,
+    // argc: calls the lambda below the arguments in place of the current frame
+    kTailCall,
+    // constant: calls the function on top with the unevaluated arguments in the constant
+    kCallFunction,
+    // constant argc: pops the evaluated arguments and pushes the result of the primitive of the
+    // Reserved constant
+    kCallPrimitive,
+    kReturn,
+    // op: throws unless the value on top is a number, the op names the builtin
+    kCheckNumber,
+    // pop a number and the accumulated number, push the result
+    kAdd,
+    kMultiply,
+    kSubtract,
+    kDivide,
+    kMax,
+    kMin,
+    kNegate,
+    // target: pops a number and the previous one. With target 0 pushes the result of the
+    // comparison, otherwise pushes the number back or pops both and jumps if the comparison fails
+    kEqual,
+    kLess,
+    kGreater,
+    kLessEqual,
+    kGreaterEqual,
+    kCar,
+    kCdr,
+    kCons,
+    // count: pops the values and pushes the list of them
+    kList,
+    kIsNull,
+    kNot,
+};
+
+// builtins whose calls are inlined
+enum class Builtin : uint8_t;
+
+// Bytecode with its constants
+class Code : public Object {
+public:
+    static constexpr ObjectType kFirstType = ObjectType::kCode;
+    static constexpr ObjectType kLastType = ObjectType::kCode;
+
+    Code(std::vector<uint32_t> ops, std::vector<Object*> constants);
+    ~Code() = default;
+
+    const std::vector<uint32_t>& GetOps() const {
+        return ops_;
+    }
+    const std::vector<Object*>& GetConstants() const {
+        return constants_;
+    }
+
+protected:
+    virtual void Trace(Tracer& tracer) override;
+    virtual Object* MoveTo(void* slot) override;
+
+private:
+    std::vector<uint32_t> ops_;
+    std::vector<Object*> constants_;
+};
+
+// Lowers expressions to bytecode that evaluates them exactly like Eval. Calls of if, quote, and,
+// or and the arithmetic and list builtins are inlined behind a guard checking that the name
+// still refers to the builtin, other primitive builtins are called directly behind the same
+// guard, every other call goes through Function::Call.
+// Compilation never fails: malformed expressions compile to code raising the errors Eval raises.
+class Compiler {
+public:
+    // code evaluating `obj` and returning its value
+    static Object* CompileExpression(Object* obj);
+
+    // code evaluating the body of a resolved lambda created in `scope` and returning the value of
+    // the last expression, nullptr if the body is not a proper list. Constant expressions are
+    // folded, see FoldConstant
+    static Object* CompileBody(Object* body, Object* scope);
+
+private:
+    Compiler() = default;
+
+    // a call in tail position replaces the frame of the caller
+    void Compile(Object* obj, bool tail = false);
+    void CompileCall(Cell* form, bool tail);
+    // false unless the call is a constant expression or an if with a constant test
+    bool CompileFolded(Cell* form, bool tail);
+    void CompileBuiltin(Builtin builtin, const std::vector<Object*>& args, bool tail);
+    // `empty` is the value of a call without arguments
+    void CompileFold(Op op, const std::vector<Object*>& args, Object* empty);
+    void CompileCompare(Op op, const std::vector<Object*>& args);
+    void CompileBoolOp(bool stop_value, const std::vector<Object*>& args, bool tail);
+
+    void Emit(Op op);
+    void Emit(uint32_t operand);
+    uint32_t AddConstant(Object* obj);
+    // emits a placeholder jump target to be patched by Bind
+    size_t EmitTarget();
+    void Bind(size_t target);
+    Object* Finish();
+
+    // where the lambda is created, nullptr for expressions that are not folded
+    Object* scope_ = nullptr;
+    bool fold_ = true;
+    std::vector<uint32_t> ops_;
+    std::vector<Object*> constants_;
+};
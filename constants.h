@@ -31,6 +31,7 @@ const std::string kMustNotNull = " arguments must not equals ()";
 
 const std::string kOutOfRange = " out of range";
 const std::string kZeroDivision = " caught zero division";
+const std::string kTooDeep = "Recursion is too deep";
 
 // ---- functions ----
 
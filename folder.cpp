@@ -0,0 +1,146 @@
+#include "folder.h"
+
+#include "constants.h"
+#include "error.h"
+#include "heap.h"
+#include "helpers.h"
+#include "object.h"
+#include "scheme.h"
+#include "scope.h"
+#include "stack_limit.h"
+#include "symbol_table.h"
+
+#include <stdexcept>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace {
+
+Object* GetBuiltin(const std::string& name) {
+    return FindBuiltin(SymbolTable::Get().GetId(name));
+}
+
+// builtins without side effects whose value depends only on the arguments
+bool IsPure(Object* builtin) {
+    static const std::unordered_set<Object*> pure = [] {
+        std::unordered_set<Object*> pure;
+        for (const auto& name : {kPlus, kMinus, kMultiply, kDivide, kMax, kMin, kAbs, kEqual,
+                                 kLess, kGreater, kLEqual, kGEqual, kAnd, kOr, kNot, kIsNumber,
+                                 kIsBool, kIsSymbol, kIsNull, kIsPair, kIsList}) {
+            pure.insert(GetBuiltin(name));
+        }
+        return pure;
+    }();
+    return pure.contains(builtin);
+}
+
+// quoted lists may be changed by set-car! and set-cdr!, so only atoms are folded into calls
+bool IsAtom(Object* value) {
+    return !Is<Cell>(value);
+}
+
+bool IsFalse(Object* value) {
+    return Is<Bool>(value) && !GetBoolValue(value);
+}
+
+// the value of the call of the builtin with the values, special forms get numbers and booleans
+// only, which evaluate to themselves
+Object* Apply(Reserved* builtin, const std::vector<Object*>& values, Object* scope) {
+    if (auto primitive = builtin->GetPrimitive()) {
+        return primitive(values.data());
+    }
+    Object* args = nullptr;
+    Root args_root(args);
+    for (auto value = values.rbegin(); value != values.rend(); ++value) {
+        Object* cell = Heap::GetHeap().Make<Cell>();
+        As<Cell>(cell)->SetFirst(*value);
+        As<Cell>(cell)->SetSecond(args);
+        args = cell;
+    }
+    return builtin->Call(args, scope);
+}
+
+bool FoldCall(Cell* form, Object* scope, Object*& value) {
+    static Object* const kQuoteBuiltin = GetBuiltin(kQuote);
+    static Object* const kIfBuiltin = GetBuiltin(kIf);
+    if (!CheckProperList(form->GetSecond())) {
+        return false;
+    }
+    auto builtin = static_cast<Reserved*>(FoldBuiltin(form->GetFirst(), scope));
+    ProperList args(form->GetSecond());
+    if (!builtin || !builtin->Accepts(args.size())) {
+        return false;
+    }
+    if (builtin == kQuoteBuiltin) {
+        value = args[0];
+        return true;
+    }
+    if (builtin == kIfBuiltin) {
+        Object* test;
+        if (!FoldConstant(args[0], scope, test)) {
+            return false;
+        }
+        if (!IsFalse(test)) {
+            return FoldConstant(args[1], scope, value);
+        }
+        if (args.size() == 2) {
+            value = nullptr;
+            return true;
+        }
+        return FoldConstant(args[2], scope, value);
+    }
+    if (!IsPure(builtin)) {
+        return false;
+    }
+    std::vector<Object*> values;
+    for (Object* arg : args) {
+        Object* arg_value;
+        if (!FoldConstant(arg, scope, arg_value) || !IsAtom(arg_value)) {
+            return false;
+        }
+        if (!builtin->GetPrimitive() && !Is<Number>(arg_value) && !Is<Bool>(arg_value)) {
+            return false;
+        }
+        values.push_back(arg_value);
+    }
+    Object* result;
+    try {
+        result = Apply(builtin, values, scope);
+    } catch (const std::runtime_error&) {
+        return false;
+    }
+    // a new heap object would not survive until the folded body is traced
+    if (IsHeapObject(result)) {
+        return false;
+    }
+    value = result;
+    return true;
+}
+
+}  // namespace
+
+Object* FoldBuiltin(Object* head, Object* scope) {
+    if (!Is<GlobalSymbol>(head) || Scope::HasDynamicFrames()) {
+        return nullptr;
+    }
+    Object* func;
+    try {
+        func = As<Scope>(scope)->GetGlobal(static_cast<GlobalSymbol*>(head));
+    } catch (const NameError&) {
+        return nullptr;
+    }
+    return Is<Reserved>(func) ? func : nullptr;
+}
+
+bool FoldConstant(Object* expr, Object* scope, Object*& value) {
+    if (Is<Number>(expr) || Is<Bool>(expr)) {
+        value = expr;
+        return true;
+    }
+    if (!Is<Cell>(expr)) {
+        return false;
+    }
+    StackLimit::Check();
+    return FoldCall(static_cast<Cell*>(expr), scope, value);
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "object_fwd.h"
+
+// Constant folding of lambda bodies. A constant expression is a number, a boolean, a quotation,
+// an if with a constant test and constant branches, or a call of a pure builtin with constant
+// atoms as arguments whose value is a number or a boolean. Calls that raise an error are not
+// folded, so the error is raised when the body runs.
+// Folding assumes that the names of the builtins keep their values, which holds as long as
+// Scope::GetBuiltinEpoch() does not change. Nothing is folded while frames hold names outside of
+// their slots, since those may shadow the builtins.
+
+// the builtin a call head in a lambda body created in `scope` refers to, nullptr if it may refer
+// to anything else
+Object* FoldBuiltin(Object* head, Object* scope);
+
+// whether `expr` in a lambda body created in `scope` always evaluates to the same value, which is
+// stored in `value`
+bool FoldConstant(Object* expr, Object* scope, Object*& value);
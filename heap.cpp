@@ -1,14 +1,70 @@
 #include "heap.h"
 
 #include "object.h"
+#include "parallel.h"
 #include "scope.h"
 
+#include <algorithm>
+#include <bit>
+#include <chrono>
 #include <cstddef>
 #include <string>
 #include <vector>
 
 std::unique_ptr<Heap> Heap::instance;
 
+namespace {
+
+// adds the time spent in its scope to the pause histogram
+class PauseTimer {
+public:
+    PauseTimer(Heap::Stats* stats) : stats_(stats), start_(std::chrono::steady_clock::now()) {
+    }
+
+    ~PauseTimer() {
+        auto pause = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start_);
+        size_t microseconds = pause.count();
+        size_t bucket = std::min<size_t>(std::bit_width(microseconds), Heap::kPauseBuckets - 1);
+        ++stats_->pause_histogram[bucket];
+        stats_->max_pause = std::max(stats_->max_pause, microseconds);
+    }
+
+private:
+    Heap::Stats* stats_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+void DestroyObject(void* slot) {
+    static_cast<Object*>(slot)->~Object();
+}
+
+}  // namespace
+
+Tracer::Tracer(std::vector<Object*>* stack, Mode mode)
+    : stack_(stack), mode_(mode), next_(nullptr) {
+}
+
+bool Tracer::Drain(size_t budget) {
+    for (; budget; --budget) {
+        Object* obj = next_;
+        if (!obj) {
+            if (stack_->empty()) {
+                return true;
+            }
+            obj = stack_->back();
+            stack_->pop_back();
+        }
+        next_ = nullptr;
+        obj->Trace(*this);
+    }
+    if (next_) {
+        stack_->push_back(next_);
+        next_ = nullptr;
+    }
+    return stack_->empty();
+}
+
 Heap& Heap::GetHeap() {
     if (!instance) {
         instance = std::unique_ptr<Heap>(new Heap());
@@ -16,30 +72,294 @@ Heap& Heap::GetHeap() {
     return *instance;
 }
 
+void Heap::WriteBarrier(Object* owner, Object* value) {
+    // outside of a collection only old objects are marked, while marking marked objects are
+    // gray or black
+    if (!IsHeapObject(value) || !IsMarked(owner) || IsMarked(value)) {
+        return;
+    }
+    if (marking_) {
+        Slab::Of(value)->Mark(value);
+        mark_stack_.push_back(value);
+        return;
+    }
+    if (Slab::Of(owner)->Remember(owner)) {
+        remembered_.push_back(owner);
+    }
+}
+
+void Heap::Promote(Object* obj) {
+    Slab* slab = Slab::Of(obj);
+    if (slab->Mark(obj) && slab->Remember(obj)) {
+        remembered_.push_back(obj);
+    }
+}
+
+void Heap::Collect() {
+    CollectGarbage(false);
+}
+
+void Heap::CollectAtSafePoint() {
+    CollectGarbage(copying_);
+}
+
+void Heap::CollectGarbage(bool can_move) {
+    PauseTimer timer(&stats_);
+    free_frames_.clear();
+    if (marking_) {
+        MarkSlice();
+        return;
+    }
+    if (can_move) {
+        EvacuateYoung();
+    } else {
+        CollectYoung();
+    }
+    if (old_count_ > old_limit_) {
+        StartMarking();
+        MarkSlice();
+    }
+}
+
 void Heap::MarkAndSweep() {
-    root_->Mark();
-    std::vector<Object*> new_objects;
-    for (const auto& obj : objects_) {
-        if (obj->IsMarked()) {
-            obj->UnMark();
-            new_objects.push_back(obj);
+    PauseTimer timer(&stats_);
+    free_frames_.clear();
+    if (!marking_) {
+        StartMarking();
+    }
+    FinishMarking(false);
+}
+
+void Heap::SetSliceBudget(size_t budget) {
+    slice_budget_ = budget;
+}
+
+void Heap::SetCopying(bool copying) {
+    copying_ = copying;
+}
+
+void Heap::SetYoungLimit(size_t bytes) {
+    young_bytes_ = bytes;
+    young_limit_ = bytes;
+}
+
+void Heap::SetThreadCount(size_t threads) {
+    threads_ = std::max<size_t>(threads, 1);
+}
+
+void* Heap::Allocate(size_t size) {
+    if (young_size_ >= young_limit_) {
+        Collect();
+    }
+    young_size_ += size;
+    ++stats_.allocations;
+    void* slot = allocator_.Allocate(size);
+    if (marking_) {
+        Slab::Of(slot)->Mark(slot);
+    }
+    return slot;
+}
+
+void Heap::MarkRoots(Tracer& tracer) {
+    tracer.Visit(root_);
+    for (auto& obj : permanent_) {
+        tracer.Visit(obj);
+    }
+    for (const auto& slot : roots_) {
+        tracer.Visit(*slot);
+    }
+    for (const auto& list : root_lists_) {
+        for (auto& obj : *list) {
+            tracer.Visit(obj);
+        }
+    }
+}
+
+void Heap::CollectYoung() {
+    Tracer tracer(&mark_stack_);
+    MarkRoots(tracer);
+    for (const auto& obj : remembered_) {
+        Slab::Of(obj)->Forget(obj);
+        obj->Trace(tracer);
+    }
+    remembered_.clear();
+    tracer.Drain();
+    for (const auto& obj : young_) {
+        if (IsMarked(obj)) {
+            ++old_count_;
+        } else {
+            Destroy(obj);
+        }
+    }
+    young_.clear();
+    young_size_ = 0;
+    ++stats_.minor_collections;
+}
+
+void Heap::EvacuateYoung() {
+    allocator_.OpenFreshSlabs();
+    // the queue of copies plays the role of the scan pointer in Cheney's algorithm
+    Tracer tracer(&mark_stack_, Tracer::Mode::kEvacuate);
+    MarkRoots(tracer);
+    for (const auto& obj : remembered_) {
+        Slab::Of(obj)->Forget(obj);
+        obj->Trace(tracer);
+    }
+    remembered_.clear();
+    for (size_t scan = 0; scan < mark_stack_.size(); ++scan) {
+        mark_stack_[scan]->Trace(tracer);
+    }
+    old_count_ += mark_stack_.size();
+    mark_stack_.clear();
+    for (const auto& obj : young_) {
+        if (Slab::Of(obj)->GetForward(obj)) {
+            allocator_.Free(obj);
+        } else if (IsMarked(obj)) {
+            ++old_count_;
         } else {
-            delete obj;
+            Destroy(obj);
         }
     }
-    objects_ = new_objects;
+    allocator_.ReleaseEmpty();
+    young_.clear();
+    young_size_ = 0;
+    ++stats_.minor_collections;
+}
+
+Object* Heap::Evacuate(Object* obj, std::vector<Object*>* queue) {
+    Slab* slab = Slab::Of(obj);
+    if (void* copy = slab->GetForward(obj)) {
+        return static_cast<Object*>(copy);
+    }
+    if (slab->IsMarked(obj)) {
+        return obj;
+    }
+    Object* copy = obj->MoveTo(allocator_.Allocate(slab->GetObjectSize()));
+    obj->~Object();
+    slab->SetForward(obj, copy);
+    Slab::Of(copy)->Mark(copy);
+    queue->push_back(copy);
+    return copy;
+}
+
+void Heap::StartMarking() {
+    allocator_.FinishLazySweep();
+    allocator_.ClearMarks();
+    for (const auto& obj : remembered_) {
+        Slab::Of(obj)->Forget(obj);
+    }
+    remembered_.clear();
+    Tracer tracer(&mark_stack_);
+    MarkRoots(tracer);
+    tracer.Drain(0);
+    marking_ = true;
+}
+
+void Heap::MarkSlice() {
+    if (!slice_budget_) {
+        FinishMarking(true);
+        return;
+    }
+    Tracer tracer(&mark_stack_);
+    ++stats_.mark_slices;
+    if (tracer.Drain(slice_budget_)) {
+        FinishMarking(true);
+    } else {
+        young_limit_ = young_size_ + std::min(kSliceBytes, young_bytes_);
+    }
+}
+
+void Heap::FinishMarking(bool lazy_sweep) {
+    // roots are not covered by the write barrier
+    Tracer tracer(&mark_stack_);
+    MarkRoots(tracer);
+    if (threads_ > 1) {
+        tracer.Drain(0);
+        ParallelMarker(threads_).Run(&mark_stack_);
+    } else {
+        tracer.Drain();
+    }
+    marking_ = false;
+    if (lazy_sweep) {
+        allocator_.StartLazySweep(&DestroyObject);
+    } else {
+        allocator_.Sweep(&DestroyObject, threads_);
+    }
+    old_count_ = allocator_.GetMarkedCount();
+    young_.clear();
+    young_size_ = 0;
+    young_limit_ = young_bytes_;
+    old_limit_ = std::max(kMinOldLimit, 2 * old_count_);
+    ++stats_.major_collections;
+}
+
+const Heap::Stats& Heap::GetStats() {
+    stats_.live_objects = old_count_ + young_.size();
+    stats_.slabs = allocator_.GetSlabCount();
+    return stats_;
+}
+
+bool Heap::IsMarked(const Object* obj) {
+    return Slab::Of(obj)->IsMarked(obj);
+}
+
+void Heap::Destroy(Object* obj) {
+    obj->~Object();
+    allocator_.Free(obj);
 }
 
 void Heap::SetGlobalScope(Object* scope) {
     root_ = scope;
 }
 
+Object* Heap::MakeFrame(Object* prev_scope, Object* layout) {
+    if (free_frames_.empty()) {
+        return Make<Scope>(prev_scope, layout);
+    }
+    auto frame = static_cast<Scope*>(free_frames_.back());
+    free_frames_.pop_back();
+    frame->Reuse(prev_scope, layout);
+    ++stats_.reused_frames;
+    return frame;
+}
+
+void Heap::ReleaseFrame(Object* frame) {
+    auto scope = static_cast<Scope*>(frame);
+    if (scope->captured_ || scope->objects_ || As<FrameLayout>(scope->layout_)->MayEscape()) {
+        return;
+    }
+    free_frames_.push_back(frame);
+}
+
 Heap::Heap() {
+    young_size_ = 0;
+    young_limit_ = kDefaultYoungLimit;
+    young_bytes_ = kDefaultYoungLimit;
+    old_count_ = 0;
+    old_limit_ = kMinOldLimit;
+    marking_ = false;
+    slice_budget_ = 0;
+    threads_ = 1;
+    copying_ = false;
     root_ = nullptr;
 }
 
 Heap::~Heap() {
-    for (const auto& obj : objects_) {
-        delete obj;
-    }
+    allocator_.ForEach(&DestroyObject);
+}
+
+Root::Root(Object*& slot) {
+    Heap::GetHeap().roots_.push_back(&slot);
+}
+
+Root::~Root() {
+    Heap::GetHeap().roots_.pop_back();
+}
+
+RootList::RootList(std::vector<Object*>& list) {
+    Heap::GetHeap().root_lists_.push_back(&list);
+}
+
+RootList::~RootList() {
+    Heap::GetHeap().root_lists_.pop_back();
 }
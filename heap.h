@@ -1,14 +1,59 @@
 #pragma once
 
 #include "object_fwd.h"
+#include "slab.h"
 
+#include <array>
+#include <cstddef>
 #include <memory>
+#include <new>
 #include <type_traits>
 #include <utility>
 #include <vector>
 
+// Generational heap. New objects are born in the young generation, survivors of a minor
+// collection are promoted to the old one. Mark bits of old objects are sticky between full
+// collections, so a minor collection stops tracing as soon as it reaches an old object and only
+// visits the young generation plus the remembered set filled by the write barrier.
+// Objects are placed into size-classed slabs, so there is no malloc/free per object.
+// Full collections started by Collect sweep lazily, MarkAndSweep sweeps right away.
+// Every object referenced from C++ code must be reachable from a root: the global scope,
+// a permanent object or a local variable registered with Root/RootList. Allocation may trigger
+// a collection at any point of an evaluation.
+// Full collections are either stop-the-world or incremental. Incremental marking keeps the
+// tri-color invariant with the write barrier: while marking, an object stored into a marked
+// (gray or black) object is shaded, and objects allocated during marking are born black.
+// Marking runs in slices interleaved with allocation, roots are rescanned in the final slice.
+// The marking that finishes a full collection and its sweep may use several threads.
+// Optionally collections at safe points copy young survivors into fresh slabs in breadth-first
+// order, so list spines built by one evaluation end up next to each other in memory.
+// Frames of lambda calls that cannot be referenced once the call returns are released into a
+// pool and reused by the next calls without a collection. Pooled frames are not roots: the pool
+// is emptied whenever a collection starts, so they are freed or moved like any garbage.
 class Heap {
+    friend class Root;
+    friend class RootList;
+    friend class Tracer;
+
 public:
+    static constexpr size_t kDefaultYoungLimit = 1 << 22;
+    // bucket `id` counts pauses shorter than 2^id microseconds and not shorter than 2^(id-1)
+    static constexpr size_t kPauseBuckets = 32;
+
+    struct Stats {
+        size_t allocations = 0;
+        // frames taken from the pool instead of being allocated
+        size_t reused_frames = 0;
+        size_t minor_collections = 0;
+        size_t major_collections = 0;
+        size_t mark_slices = 0;
+        size_t live_objects = 0;
+        size_t slabs = 0;
+        std::array<size_t, kPauseBuckets> pause_histogram = {};
+        // in microseconds
+        size_t max_pause = 0;
+    };
+
     static Heap& GetHeap();
     Heap(const Heap& other) = delete;
     Heap(Heap&& other) = delete;
@@ -17,24 +62,128 @@ public:
 
     template <class T, class... Args>
     requires std::is_base_of_v<Object, T> Object* Make(Args&&... args) {
-        objects_.emplace_back(new T(std::forward<Args>(args)...));
-        return objects_.back();
+        static_assert(sizeof(T) <= SlabAllocator::kMaxObjectSize);
+        young_.emplace_back(new (Allocate(sizeof(T))) T(std::forward<Args>(args)...));
+        return young_.back();
     }
     template <class T>
     requires std::is_base_of_v<Object, T> Object* Clone(T* obj) {
-        objects_.emplace_back(new T(*obj));
-        return objects_.back();
+        static_assert(sizeof(T) <= SlabAllocator::kMaxObjectSize);
+        young_.emplace_back(new (Allocate(sizeof(T))) T(*obj));
+        return young_.back();
+    }
+    // the object is a root for the whole lifetime of the heap and never moves
+    template <class T, class... Args>
+    requires std::is_base_of_v<Object, T> Object* MakePermanent(Args&&... args) {
+        permanent_.push_back(Make<T>(std::forward<Args>(args)...));
+        Promote(permanent_.back());
+        return permanent_.back();
     }
 
     void SetGlobalScope(Object* scope);
 
+    // frame with unbound slots for a call of a lambda with the layout created in `prev_scope`
+    Object* MakeFrame(Object* prev_scope, Object* layout);
+    // must be called once the call of the frame returned and nothing but the caller refers to
+    // it. The frame goes back to the pool unless its lambda may escape, a closure was created in
+    // it or a name was defined in it outside of its slots
+    void ReleaseFrame(Object* frame);
+
+    // must be called after `owner` starts pointing to `value`
+    void WriteBarrier(Object* owner, Object* value);
+
+    // minor collection, followed by a full one if the old generation outgrew its limit.
+    // While incremental marking is in progress does one marking slice instead
+    void Collect();
+
+    // same as Collect, must be called only when no C++ code holds unrooted object pointers,
+    // since with copying enabled young objects are moved
+    void CollectAtSafePoint();
+
+    // stop-the-world full collection with an eager sweep, finishes incremental marking if it
+    // is in progress
     void MarkAndSweep();
 
+    // number of objects traced per incremental marking slice, 0 makes full collections
+    // stop-the-world
+    void SetSliceBudget(size_t budget);
+
+    // number of threads finishing full collections, 1 keeps them on the calling thread
+    void SetThreadCount(size_t threads);
+
+    // makes collections at safe points evacuate the young generation instead of promoting
+    // survivors in place
+    void SetCopying(bool copying);
+
+    // bytes allocated in the young generation that trigger a collection, small limits make
+    // collections happen in the middle of almost every evaluation
+    void SetYoungLimit(size_t bytes);
+
+    const Stats& GetStats();
+
     ~Heap();
 
 private:
+    static constexpr size_t kMinOldLimit = 1 << 12;
+    // bytes allocated between two incremental marking slices
+    static constexpr size_t kSliceBytes = 1 << 16;
+
     Heap();
-    std::vector<Object*> objects_;
+    void* Allocate(size_t size);
+    void MarkRoots(Tracer& tracer);
+    // makes a young object old right away, its references are traced by the next collection
+    void Promote(Object* obj);
+    void CollectGarbage(bool can_move);
+    void CollectYoung();
+    // copies the young survivors, the copies are promoted to the old generation
+    void EvacuateYoung();
+    // returns the new address of `obj`, queueing it if it was copied just now
+    Object* Evacuate(Object* obj, std::vector<Object*>* queue);
+    void StartMarking();
+    void MarkSlice();
+    // dead objects are destroyed either right away or lazily as their slabs are reused
+    void FinishMarking(bool lazy_sweep);
+    static bool IsMarked(const Object* obj);
+    void Destroy(Object* obj);
+
+    SlabAllocator allocator_;
+    size_t young_size_;
+    // allocation collects once young_size_ reaches it
+    size_t young_limit_;
+    // young_limit_ after a collection, see SetYoungLimit
+    size_t young_bytes_;
+    std::vector<Object*> young_;
+    std::vector<Object*> permanent_;
+    std::vector<Object**> roots_;
+    std::vector<std::vector<Object*>*> root_lists_;
+    std::vector<Object*> remembered_;
+    std::vector<Object*> mark_stack_;
+    std::vector<Object*> free_frames_;
+    size_t old_count_;
+    size_t old_limit_;
+    bool marking_;
+    size_t slice_budget_;
+    size_t threads_;
+    bool copying_;
+    Stats stats_;
     Object* root_;
     static std::unique_ptr<Heap> instance;
 };
+
+// Registers a local variable as a root until the end of its scope
+class Root {
+public:
+    Root(Object*& slot);
+    Root(const Root& other) = delete;
+    Root& operator=(const Root& other) = delete;
+    ~Root();
+};
+
+// Registers every element of a local vector as a root until the end of its scope
+class RootList {
+public:
+    RootList(std::vector<Object*>& list);
+    RootList(const RootList& other) = delete;
+    RootList& operator=(const RootList& other) = delete;
+    ~RootList();
+};
@@ -14,22 +14,44 @@ bool CheckProperList(Object* obj) {
     return true;
 }
 
-std::vector<Object*> GetProperList(Object* obj, const std::string context) {
+namespace {
+
+void ThrowImproper(const std::string& context) {
+    if (context.empty()) {
+        throw RuntimeError("List must be proper");
+    } else {
+        throw RuntimeError("List must be proper in " + context);
+    }
+}
+
+}  // namespace
+
+std::vector<Object*> GetProperList(Object* obj, const std::string& context) {
     std::vector<Object*> list;
-    while (obj != nullptr) {
-        if (!Is<Cell>(obj)) {
-            if (context.empty()) {
-                throw RuntimeError("List must be proper");
-            } else {
-                throw RuntimeError("List must be proper in " + context);
-            }
-        }
-        list.emplace_back(As<Cell>(obj)->GetFirst());
-        obj = As<Cell>(obj)->GetSecond();
+    for (Object* elem : ProperList(obj, context)) {
+        list.emplace_back(elem);
     }
     return list;
 }
 
+ProperList::ProperList(Object* list, const std::string& context) : list_(list), size_(0) {
+    while (list != nullptr) {
+        if (!Is<Cell>(list)) {
+            ThrowImproper(context);
+        }
+        ++size_;
+        list = As<Cell>(list)->GetSecond();
+    }
+}
+
+Object* ProperList::operator[](size_t id) const {
+    Object* cell = list_;
+    while (id-- > 0) {
+        cell = static_cast<Cell*>(cell)->GetSecond();
+    }
+    return static_cast<Cell*>(cell)->GetFirst();
+}
+
 std::vector<Object*> GetList(Object* obj) {
     std::vector<Object*> list;
     while (obj != nullptr) {
@@ -44,8 +66,15 @@ std::vector<Object*> GetList(Object* obj) {
 }
 
 bool CheckPair(Object* obj) {
-    auto list = GetList(obj);
-    return list.size() == 2;
+    // GetList(obj) has two elements
+    if (!Is<Cell>(obj)) {
+        return false;
+    }
+    Object* rest = As<Cell>(obj)->GetSecond();
+    if (!Is<Cell>(rest)) {
+        return rest != nullptr;
+    }
+    return As<Cell>(rest)->GetSecond() == nullptr;
 }
 
 std::pair<Object*, Object*> GetPair(Object* obj) {
@@ -2,12 +2,77 @@
 
 #include "object.h"
 
+#include <cstddef>
+#include <iterator>
 #include <memory>
+#include <string>
 #include <vector>
 
 bool CheckProperList(Object* obj);
 
-std::vector<Object*> GetProperList(Object* obj, const std::string context = "");
+std::vector<Object*> GetProperList(Object* obj, const std::string& context = "");
+
+// Non-owning view of the elements of a proper list. The constructor walks the list once to check
+// that it is proper and to count the elements, so passing arguments through it never allocates.
+// The list must not change while the view is used.
+class ProperList {
+public:
+    class Iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = Object*;
+        using difference_type = std::ptrdiff_t;
+        using pointer = Object* const*;
+        using reference = Object*;
+
+        Iterator() : cell_(nullptr) {
+        }
+        explicit Iterator(Object* cell) : cell_(cell) {
+        }
+
+        Object* operator*() const {
+            return static_cast<Cell*>(cell_)->GetFirst();
+        }
+        Iterator& operator++() {
+            cell_ = static_cast<Cell*>(cell_)->GetSecond();
+            return *this;
+        }
+        Iterator operator++(int) {
+            Iterator copy = *this;
+            ++*this;
+            return copy;
+        }
+        bool operator==(const Iterator& other) const {
+            return cell_ == other.cell_;
+        }
+
+    private:
+        Object* cell_;
+    };
+
+    // throws a RuntimeError naming `context` if the list is not proper
+    explicit ProperList(Object* list, const std::string& context = "");
+
+    size_t size() const {
+        return size_;
+    }
+    bool empty() const {
+        return size_ == 0;
+    }
+    // walks `id` cells
+    Object* operator[](size_t id) const;
+
+    Iterator begin() const {
+        return Iterator(list_);
+    }
+    Iterator end() const {
+        return Iterator();
+    }
+
+private:
+    Object* list_;
+    size_t size_;
+};
 
 std::vector<Object*> GetList(Object* obj);
 
@@ -0,0 +1,613 @@
+#include "jit.h"
+
+#include "constants.h"
+#include "error.h"
+#include "folder.h"
+#include "heap.h"
+#include "helpers.h"
+#include "object.h"
+#include "scheme.h"
+#include "scope.h"
+#include "stack_limit.h"
+#include "symbol_table.h"
+
+#include <cstring>
+#include <initializer_list>
+#include <new>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#ifdef SCHEME_JIT_X86_64
+#include <sys/mman.h>
+#endif
+
+namespace {
+
+JitStats stats;
+
+#ifdef SCHEME_JIT_X86_64
+
+int64_t GetRaw(Object* value) {
+    return static_cast<int64_t>(reinterpret_cast<uintptr_t>(value));
+}
+
+// the builtins with native code
+enum class Operation {
+    kAdd,
+    kSubtract,
+    kMultiply,
+    kEqual,
+    kLess,
+    kGreater,
+    kLEqual,
+    kGEqual,
+    kIf,
+};
+
+const std::unordered_map<Object*, Operation>& GetOperations() {
+    static const std::unordered_map<Object*, Operation> operations = [] {
+        std::unordered_map<Object*, Operation> operations;
+        for (const auto& [name, operation] :
+             {std::pair{kPlus, Operation::kAdd}, std::pair{kMinus, Operation::kSubtract},
+              std::pair{kMultiply, Operation::kMultiply}, std::pair{kEqual, Operation::kEqual},
+              std::pair{kLess, Operation::kLess}, std::pair{kGreater, Operation::kGreater},
+              std::pair{kLEqual, Operation::kLEqual}, std::pair{kGEqual, Operation::kGEqual},
+              std::pair{kIf, Operation::kIf}}) {
+            operations.emplace(FindBuiltin(SymbolTable::Get().GetId(name)), operation);
+        }
+        return operations;
+    }();
+    return operations;
+}
+
+// the condition code of setcc and jcc that holds for the comparison
+uint8_t GetCondition(Operation operation) {
+    switch (operation) {
+        case Operation::kEqual:
+            return 0x4;
+        case Operation::kLess:
+            return 0xC;
+        case Operation::kGreater:
+            return 0xF;
+        case Operation::kLEqual:
+            return 0xE;
+        default:
+            return 0xD;
+    }
+}
+
+constexpr uint8_t kOverflow = 0x0;
+constexpr uint8_t kBelow = 0x2;
+constexpr uint8_t kZero = 0x4;
+
+// Machine code with labels whose rel32 references are patched once the code is complete
+class Assembler {
+public:
+    void Emit(std::initializer_list<uint8_t> bytes) {
+        code_.insert(code_.end(), bytes);
+    }
+    void Emit32(int32_t value) {
+        EmitValue(value);
+    }
+    void Emit64(int64_t value) {
+        EmitValue(value);
+    }
+
+    size_t NewLabel() {
+        labels_.push_back(kUnbound);
+        return labels_.size() - 1;
+    }
+    void Bind(size_t label) {
+        labels_[label] = code_.size();
+    }
+    // jmp, call or jcc to the label
+    void Jump(size_t label) {
+        Emit({0xE9});
+        EmitReference(label);
+    }
+    void Call(size_t label) {
+        Emit({0xE8});
+        EmitReference(label);
+    }
+    void JumpIf(uint8_t condition, size_t label) {
+        Emit({0x0F, static_cast<uint8_t>(0x80 | condition)});
+        EmitReference(label);
+    }
+
+    std::vector<uint8_t> Finish() {
+        for (auto [position, label] : references_) {
+            auto offset = static_cast<int32_t>(labels_[label] - (position + 4));
+            std::memcpy(&code_[position], &offset, sizeof(offset));
+        }
+        return std::move(code_);
+    }
+
+private:
+    static constexpr size_t kUnbound = SIZE_MAX;
+
+    template <class T>
+    void EmitValue(T value) {
+        uint8_t bytes[sizeof(T)];
+        std::memcpy(bytes, &value, sizeof(T));
+        code_.insert(code_.end(), bytes, bytes + sizeof(T));
+    }
+    void EmitReference(size_t label) {
+        references_.emplace_back(code_.size(), label);
+        Emit32(0);
+    }
+
+    std::vector<uint8_t> code_;
+    std::vector<size_t> labels_;
+    std::vector<std::pair<size_t, size_t>> references_;
+};
+
+// Compiles a lambda body to code working on tagged values. rax holds the value of an expression,
+// rcx the right operand. A call of the body pushes the arguments, the first one deepest, and
+// keeps rbp as the frame pointer. r15 holds the stack limit, r12 the number of calls that may
+// still be nested, r14 the stack pointer of the entry to restore on a bailout and r13 the
+// address of the result.
+class Codegen {
+public:
+    Codegen(FrameLayout* layout, Object* scope)
+        : layout_(layout),
+          scope_(scope),
+          self_(nullptr),
+          bail_(assembler_.NewLabel()),
+          body_(assembler_.NewLabel()),
+          loop_(assembler_.NewLabel()) {
+    }
+
+    // false if the body uses anything without native code
+    bool CompileBody(Object* body) {
+        if (!body || !CheckProperList(body) ||
+            layout_->GetSlotCount() != layout_->GetArgCount()) {
+            return false;
+        }
+        EmitEntry();
+        assembler_.Bind(body_);
+        // push rbp; mov rbp, rsp; cmp rsp, r15; jb bail; sub r12, 1; jb bail
+        assembler_.Emit({0x55, 0x48, 0x89, 0xE5, 0x4C, 0x39, 0xFC});
+        assembler_.JumpIf(kBelow, bail_);
+        assembler_.Emit({0x49, 0x83, 0xEC, 0x01});
+        assembler_.JumpIf(kBelow, bail_);
+        assembler_.Bind(loop_);
+        ProperList forms(body);
+        for (size_t id = 0; id < forms.size(); ++id) {
+            if (!Compile(forms[id], id + 1 == forms.size())) {
+                return false;
+            }
+        }
+        // add r12, 1; mov rsp, rbp; pop rbp; ret
+        assembler_.Emit({0x49, 0x83, 0xC4, 0x01, 0x48, 0x89, 0xEC, 0x5D, 0xC3});
+        return true;
+    }
+
+    std::vector<uint8_t> Finish() {
+        return assembler_.Finish();
+    }
+    Object* GetSelf() const {
+        return self_;
+    }
+
+private:
+    // int entry(Object* const* args, uintptr_t stack_limit, size_t max_depth, Object** result)
+    void EmitEntry() {
+        // push rbx; push rbp; push r12; push r13; push r14; push r15
+        assembler_.Emit({0x53, 0x55, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57});
+        // mov r15, rsi; mov r12, rdx; mov r13, rcx; mov r14, rsp
+        assembler_.Emit({0x49, 0x89, 0xF7, 0x49, 0x89, 0xD4, 0x49, 0x89, 0xCD, 0x49, 0x89, 0xE6});
+        for (size_t id = 0; id < layout_->GetArgCount(); ++id) {
+            // push qword [rdi + 8 * id]
+            assembler_.Emit({0xFF, 0xB7});
+            assembler_.Emit32(static_cast<int32_t>(8 * id));
+        }
+        assembler_.Call(body_);
+        // mov [r13], rax; mov eax, 1
+        assembler_.Emit({0x49, 0x89, 0x45, 0x00, 0xB8, 0x01, 0x00, 0x00, 0x00});
+        size_t leave = assembler_.NewLabel();
+        assembler_.Jump(leave);
+        assembler_.Bind(bail_);
+        // xor eax, eax
+        assembler_.Emit({0x31, 0xC0});
+        assembler_.Bind(leave);
+        // mov rsp, r14; pop r15; pop r14; pop r13; pop r12; pop rbp; pop rbx; ret
+        assembler_.Emit({0x4C, 0x89, 0xF4, 0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5D,
+                         0x5B, 0xC3});
+    }
+
+    int32_t GetArgOffset(uint32_t slot) const {
+        return static_cast<int32_t>(16 + 8 * (layout_->GetArgCount() - 1 - slot));
+    }
+
+    // a constant that is not a heap object
+    bool GetConstant(Object* expr, Object*& value) {
+        return FoldConstant(expr, scope_, value) && !IsHeapObject(value);
+    }
+    bool IsArgument(Object* expr) const {
+        return Is<LocalSymbol>(expr) && !static_cast<LocalSymbol*>(expr)->GetDepth() &&
+               static_cast<LocalSymbol*>(expr)->GetSlot() < layout_->GetArgCount();
+    }
+
+    void CompileConstant(Object* value) {
+        // mov rax, imm64
+        assembler_.Emit({0x48, 0xB8});
+        assembler_.Emit64(GetRaw(value));
+    }
+
+    bool Compile(Object* expr, bool tail) {
+        Object* value;
+        if (GetConstant(expr, value)) {
+            CompileConstant(value);
+            return true;
+        }
+        if (IsArgument(expr)) {
+            // mov rax, [rbp + offset]
+            assembler_.Emit({0x48, 0x8B, 0x85});
+            assembler_.Emit32(GetArgOffset(static_cast<LocalSymbol*>(expr)->GetSlot()));
+            return true;
+        }
+        if (!Is<Cell>(expr)) {
+            return false;
+        }
+        StackLimit::Check();
+        return CompileCall(static_cast<Cell*>(expr), tail);
+    }
+
+    // evaluates the right operand into rcx, keeping rax
+    bool CompileOperand(Object* expr) {
+        Object* value;
+        if (GetConstant(expr, value)) {
+            // mov rcx, imm64
+            assembler_.Emit({0x48, 0xB9});
+            assembler_.Emit64(GetRaw(value));
+            return true;
+        }
+        if (IsArgument(expr)) {
+            // mov rcx, [rbp + offset]
+            assembler_.Emit({0x48, 0x8B, 0x8D});
+            assembler_.Emit32(GetArgOffset(static_cast<LocalSymbol*>(expr)->GetSlot()));
+            return true;
+        }
+        // push rax
+        assembler_.Emit({0x50});
+        if (!Compile(expr, false)) {
+            return false;
+        }
+        // mov rcx, rax; pop rax
+        assembler_.Emit({0x48, 0x89, 0xC1, 0x58});
+        return true;
+    }
+
+    void CheckFixnum() {
+        // test al, 1; jz bail
+        assembler_.Emit({0xA8, 0x01});
+        assembler_.JumpIf(kZero, bail_);
+    }
+    void CheckOperandFixnum() {
+        // test cl, 1; jz bail
+        assembler_.Emit({0xF6, 0xC1, 0x01});
+        assembler_.JumpIf(kZero, bail_);
+    }
+
+    bool CompileCall(Cell* form, bool tail) {
+        if (!CheckProperList(form->GetSecond())) {
+            return false;
+        }
+        ProperList args(form->GetSecond());
+        auto builtin = static_cast<Reserved*>(FoldBuiltin(form->GetFirst(), scope_));
+        if (!builtin) {
+            return CompileSelfCall(form->GetFirst(), args, tail);
+        }
+        const auto& operations = GetOperations();
+        auto it = operations.find(builtin);
+        if (it == operations.end() || !builtin->Accepts(args.size())) {
+            return false;
+        }
+        switch (it->second) {
+            case Operation::kAdd:
+            case Operation::kSubtract:
+            case Operation::kMultiply:
+                return CompileArithmetic(it->second, args);
+            case Operation::kIf:
+                return CompileIf(args, tail);
+            default:
+                if (args.size() != 2 || !CompileComparison(args)) {
+                    return false;
+                }
+                // setcc al; movzx eax, al; lea rax, [rax * 4 + #f]
+                assembler_.Emit({0x0F, static_cast<uint8_t>(0x90 | GetCondition(it->second)),
+                                 0xC0, 0x0F, 0xB6, 0xC0, 0x48, 0x8D, 0x04, 0x85});
+                assembler_.Emit32(static_cast<int32_t>(GetRaw(MakeBool(false))));
+                return true;
+        }
+    }
+
+    bool CompileArithmetic(Operation operation, const ProperList& args) {
+        if (args.empty()) {
+            if (operation == Operation::kSubtract) {
+                return false;
+            }
+            CompileConstant(MakeNumber(operation == Operation::kAdd ? 0 : 1));
+            return true;
+        }
+        if (!Compile(args[0], false)) {
+            return false;
+        }
+        CheckFixnum();
+        if (operation == Operation::kSubtract && args.size() == 1) {
+            // mov rcx, rax; mov rax, 2; sub rax, rcx; jo bail
+            assembler_.Emit({0x48, 0x89, 0xC1, 0x48, 0xB8});
+            assembler_.Emit64(2);
+            assembler_.Emit({0x48, 0x29, 0xC8});
+            assembler_.JumpIf(kOverflow, bail_);
+            return true;
+        }
+        for (size_t id = 1; id < args.size(); ++id) {
+            if (!CompileOperand(args[id])) {
+                return false;
+            }
+            CheckOperandFixnum();
+            if (operation == Operation::kAdd) {
+                // sub rcx, 1; add rax, rcx
+                assembler_.Emit({0x48, 0x83, 0xE9, 0x01, 0x48, 0x01, 0xC8});
+            } else if (operation == Operation::kSubtract) {
+                // sub rcx, 1; sub rax, rcx
+                assembler_.Emit({0x48, 0x83, 0xE9, 0x01, 0x48, 0x29, 0xC8});
+            } else {
+                // sar rax, 1; sub rcx, 1; imul rax, rcx
+                assembler_.Emit({0x48, 0xD1, 0xF8, 0x48, 0x83, 0xE9, 0x01, 0x48, 0x0F, 0xAF, 0xC1});
+            }
+            assembler_.JumpIf(kOverflow, bail_);
+            if (operation == Operation::kMultiply) {
+                // add rax, 1
+                assembler_.Emit({0x48, 0x83, 0xC0, 0x01});
+            }
+        }
+        return true;
+    }
+
+    // compares two fixnums, setting the flags
+    bool CompileComparison(const ProperList& args) {
+        if (!Compile(args[0], false) || !CompileOperand(args[1])) {
+            return false;
+        }
+        CheckFixnum();
+        CheckOperandFixnum();
+        // cmp rax, rcx
+        assembler_.Emit({0x48, 0x39, 0xC8});
+        return true;
+    }
+
+    // jumps to `otherwise` if the test is false
+    bool CompileTest(Object* test, size_t otherwise) {
+        if (Is<Cell>(test) && CheckProperList(As<Cell>(test)->GetSecond())) {
+            const auto& operations = GetOperations();
+            auto it = operations.find(FoldBuiltin(As<Cell>(test)->GetFirst(), scope_));
+            ProperList args(As<Cell>(test)->GetSecond());
+            if (it != operations.end() && it->second >= Operation::kEqual &&
+                it->second <= Operation::kGEqual && args.size() == 2) {
+                if (!CompileComparison(args)) {
+                    return false;
+                }
+                // the inverse condition differs in the lowest bit
+                assembler_.JumpIf(GetCondition(it->second) ^ 1, otherwise);
+                return true;
+            }
+        }
+        if (!Compile(test, false)) {
+            return false;
+        }
+        // cmp rax, #f; je otherwise
+        assembler_.Emit({0x48, 0x83, 0xF8, static_cast<uint8_t>(GetRaw(MakeBool(false)))});
+        assembler_.JumpIf(kZero, otherwise);
+        return true;
+    }
+
+    bool CompileIf(const ProperList& args, bool tail) {
+        size_t otherwise = assembler_.NewLabel();
+        size_t end = assembler_.NewLabel();
+        if (!CompileTest(args[0], otherwise) || !Compile(args[1], tail)) {
+            return false;
+        }
+        assembler_.Jump(end);
+        assembler_.Bind(otherwise);
+        if (args.size() == 2) {
+            CompileConstant(nullptr);
+        } else if (!Compile(args[2], tail)) {
+            return false;
+        }
+        assembler_.Bind(end);
+        return true;
+    }
+
+    bool CompileSelfCall(Object* head, const ProperList& args, bool tail) {
+        if (!Is<GlobalSymbol>(head) || args.size() != layout_->GetArgCount()) {
+            return false;
+        }
+        // every occurrence of the name is a symbol of its own
+        if (self_ && As<Symbol>(self_)->GetId() != As<Symbol>(head)->GetId()) {
+            return false;
+        }
+        Object* func;
+        try {
+            func = As<Scope>(scope_)->GetGlobal(static_cast<GlobalSymbol*>(head));
+        } catch (const NameError&) {
+            return false;
+        }
+        if (!Is<Lambda>(func) || As<Lambda>(func)->GetLayout() != layout_) {
+            return false;
+        }
+        self_ = head;
+        for (Object* arg : args) {
+            if (!Compile(arg, false)) {
+                return false;
+            }
+            // push rax
+            assembler_.Emit({0x50});
+        }
+        if (!tail) {
+            assembler_.Call(body_);
+            // add rsp, 8 * argc
+            assembler_.Emit({0x48, 0x81, 0xC4});
+            assembler_.Emit32(static_cast<int32_t>(8 * args.size()));
+            return true;
+        }
+        // the arguments replace the ones of the current call
+        for (size_t slot = args.size(); slot-- > 0;) {
+            // pop rax; mov [rbp + offset], rax
+            assembler_.Emit({0x58, 0x48, 0x89, 0x85});
+            assembler_.Emit32(GetArgOffset(slot));
+        }
+        assembler_.Jump(loop_);
+        return true;
+    }
+
+    FrameLayout* layout_;
+    Object* scope_;
+    Object* self_;
+    Assembler assembler_;
+    size_t bail_;
+    size_t body_;
+    size_t loop_;
+};
+
+// executable copy of the code, nullptr if the system refuses to map one
+void* MapCode(const std::vector<uint8_t>& code) {
+    void* memory =
+        mmap(nullptr, code.size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        return nullptr;
+    }
+    std::memcpy(memory, code.data(), code.size());
+    if (mprotect(memory, code.size(), PROT_READ | PROT_EXEC)) {
+        munmap(memory, code.size());
+        return nullptr;
+    }
+    return memory;
+}
+
+Object* Compile(FrameLayout* layout, Object* scope) {
+    size_t epoch = Scope::GetBuiltinEpoch();
+    Codegen codegen(layout, scope);
+    bool compiled;
+    try {
+        compiled = codegen.CompileBody(layout->GetBody());
+    } catch (const RuntimeError&) {
+        // the body is nested too deep
+        compiled = false;
+    }
+    if (compiled) {
+        auto code = codegen.Finish();
+        if (void* memory = MapCode(code)) {
+            ++stats.compiled;
+            return Heap::GetHeap().Make<JitCode>(memory, code.size(), epoch, codegen.GetSelf());
+        }
+    }
+    ++stats.rejected;
+    return Heap::GetHeap().Make<JitCode>(epoch);
+}
+
+#else
+
+Object* Compile(FrameLayout*, Object*) {
+    ++stats.rejected;
+    return Heap::GetHeap().Make<JitCode>(Scope::GetBuiltinEpoch());
+}
+
+#endif
+
+}  // namespace
+
+JitCode::JitCode(size_t epoch) : JitCode(nullptr, 0, epoch, nullptr) {
+}
+
+JitCode::JitCode(void* memory, size_t size, size_t epoch, Object* self)
+    : Object(ObjectType::kJitCode),
+      memory_(memory),
+      size_(size),
+      epoch_(epoch),
+      self_(self),
+      bailouts_(0) {
+    Heap::GetHeap().WriteBarrier(this, self_);
+}
+
+JitCode::JitCode(JitCode&& other)
+    : Object(std::move(other)),
+      memory_(std::exchange(other.memory_, nullptr)),
+      size_(other.size_),
+      epoch_(other.epoch_),
+      self_(other.self_),
+      bailouts_(other.bailouts_) {
+}
+
+JitCode::~JitCode() {
+    Release();
+}
+
+void JitCode::CountBailout() {
+    if (++bailouts_ >= kMaxBailouts) {
+        Release();
+    }
+}
+
+void JitCode::Release() {
+#ifdef SCHEME_JIT_X86_64
+    if (memory_) {
+        munmap(memory_, size_);
+    }
+#endif
+    memory_ = nullptr;
+}
+
+void JitCode::Trace(Tracer& tracer) {
+    tracer.Visit(self_);
+}
+
+Object* JitCode::MoveTo(void* slot) {
+    return new (slot) JitCode(std::move(*this));
+}
+
+bool Jit::Run(Object* frame, Object*& result, size_t max_depth) {
+    // a name outside of the slots of a frame may shadow the builtins and the lambda
+    if (!threshold_ || Scope::HasDynamicFrames()) {
+        return false;
+    }
+    auto scope = static_cast<Scope*>(static_cast<Scope*>(frame)->GetPrevScope());
+    auto layout = static_cast<FrameLayout*>(static_cast<Scope*>(frame)->GetLayout());
+    auto code = static_cast<JitCode*>(layout->GetJitCode());
+    if (code && code->GetEpoch() != Scope::GetBuiltinEpoch()) {
+        layout->SetJitCode(nullptr);
+        layout->ResetCalls();
+        code = nullptr;
+    }
+    if (!code) {
+        if (layout->CountCall() < threshold_) {
+            return false;
+        }
+        Root frame_root(frame);
+        layout->SetJitCode(Compile(layout, scope));
+        code = static_cast<JitCode*>(layout->GetJitCode());
+    }
+    JitCode::Entry* entry = code->GetEntry();
+    if (!entry) {
+        return false;
+    }
+    if (Object* self = code->GetSelf()) {
+        Object* lambda = scope->GetGlobal(static_cast<GlobalSymbol*>(self));
+        if (!Is<Lambda>(lambda) || As<Lambda>(lambda)->GetLayout() != layout) {
+            return false;
+        }
+    }
+    if (entry(static_cast<Scope*>(frame)->GetSlots(), StackLimit::GetLimit(), max_depth,
+              &result)) {
+        return true;
+    }
+    ++stats.bailouts;
+    code->CountBailout();
+    return false;
+}
+
+const JitStats& Jit::GetStats() {
+    return stats;
+}
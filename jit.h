@@ -0,0 +1,112 @@
+#pragma once
+
+#include "object.h"
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(SCHEME_JIT) && defined(__x86_64__) && defined(__linux__)
+#define SCHEME_JIT_X86_64
+#endif
+
+// Native code for hot lambdas, built with SCHEME_JIT on Linux x86-64. A lambda is compiled on its
+// threshold-th call if its body uses only numbers, booleans, its arguments, if, + - * and the
+// comparisons of two numbers, and calls of itself through its global name. The code works on
+// tagged fixnums and bails out on anything else: an argument that is not a fixnum, an overflow,
+// a call nested too deep. The interpreter then makes the whole call again, which is safe since
+// such a body has no side effects, and gives the value or raises the error the native code
+// could not.
+// The code is valid while the builtins keep their values, see Scope::GetBuiltinEpoch(), and the
+// global name still refers to the lambda. It is dropped for good after kMaxBailouts bailouts.
+
+// Native code of a lambda body, or the mark that the body is not compiled
+class JitCode : public Object {
+public:
+    static constexpr ObjectType kFirstType = ObjectType::kJitCode;
+    static constexpr ObjectType kLastType = ObjectType::kJitCode;
+    static constexpr size_t kMaxBailouts = 16;
+
+    // returns 0 if the code bailed out, `max_depth` bounds the number of nested calls
+    using Entry = int(Object* const* args, uintptr_t stack_limit, size_t max_depth,
+                      Object** result);
+
+    // a body that is not compiled
+    explicit JitCode(size_t epoch);
+    // takes over the executable mapping of `size` bytes at `memory`, which starts with the entry
+    JitCode(void* memory, size_t size, size_t epoch, Object* self);
+    JitCode(JitCode&& other);
+    ~JitCode();
+
+    // nullptr if the body is not compiled
+    Entry* GetEntry() const {
+        return reinterpret_cast<Entry*>(memory_);
+    }
+    size_t GetEpoch() const {
+        return epoch_;
+    }
+    // the GlobalSymbol the body calls itself through, nullptr if it does not
+    Object* GetSelf() const {
+        return self_;
+    }
+    // drops the code after too many bailouts
+    void CountBailout();
+
+protected:
+    virtual void Trace(Tracer& tracer) override;
+    virtual Object* MoveTo(void* slot) override;
+
+private:
+    void Release();
+
+    void* memory_;
+    size_t size_;
+    size_t epoch_;
+    Object* self_;
+    size_t bailouts_;
+};
+
+struct JitStats {
+    size_t compiled = 0;
+    size_t rejected = 0;
+    size_t bailouts = 0;
+};
+
+class Jit {
+public:
+#ifdef SCHEME_JIT_X86_64
+    static constexpr bool kSupported = true;
+#else
+    static constexpr bool kSupported = false;
+#endif
+    static constexpr size_t kDefaultThreshold = 64;
+
+    // makes the call in `frame`, whose arguments are set, with native code if the lambda is
+    // compiled, false if the interpreter has to make it. `max_depth` bounds the number of nested
+    // calls including this one. Uses the threshold of the innermost JitThreshold alive
+    static bool Run(Object* frame, Object*& result, size_t max_depth = SIZE_MAX);
+
+    static const JitStats& GetStats();
+
+private:
+    friend class JitThreshold;
+
+    static inline size_t threshold_ = 0;
+};
+
+// Threshold of the JIT while an evaluation is in progress: lambdas are compiled on their
+// `calls`-th call, 0 turns the JIT off. Each Interpreter keeps its own threshold and sets it for
+// the lines it runs, the previous one is restored afterwards.
+class JitThreshold {
+public:
+    explicit JitThreshold(size_t calls) : previous_(Jit::threshold_) {
+        Jit::threshold_ = Jit::kSupported ? calls : 0;
+    }
+    JitThreshold(const JitThreshold& other) = delete;
+    JitThreshold& operator=(const JitThreshold& other) = delete;
+    ~JitThreshold() {
+        Jit::threshold_ = previous_;
+    }
+
+private:
+    size_t previous_;
+};
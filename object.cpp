@@ -2,33 +2,44 @@
 
 #include "constants.h"
 #include "advanced.h"
+#include "assertions.h"
+#include "error.h"
 #include "heap.h"
 #include "helpers.h"
+#include "scheme.h"
 #include "scope.h"
+#include "symbol_table.h"
 
+#include <array>
 #include <memory>
+#include <new>
 #include <type_traits>
+#include <utility>
 #include <vector>
 
-void Object::Mark() {
-    marked_ = true;
+Object::Object(ObjectType type) : type_(type) {
 }
 
-void Object::UnMark() {
-    marked_ = false;
+void Object::Trace(Tracer&) {
 }
 
-bool Object::IsMarked() {
-    return marked_;
+Number::Number() : Object(ObjectType::kNumber) {
 }
 
-Number::Number(int64_t val) : value_(val){};
+Number::Number(int64_t val) : Object(ObjectType::kNumber), value_(val){};
 
 int64_t Number::GetValue() const {
     return value_;
 }
 
-Bool::Bool(bool val) : value_(val){};
+Object* Number::MoveTo(void* slot) {
+    return new (slot) Number(std::move(*this));
+}
+
+Bool::Bool() : Object(ObjectType::kBool) {
+}
+
+Bool::Bool(bool val) : Object(ObjectType::kBool), value_(val){};
 
 bool Bool::GetValue() const {
     return value_;
@@ -42,6 +53,20 @@ std::string Bool::GetName() const {
     }
 }
 
+Object* Bool::MoveTo(void* slot) {
+    return new (slot) Bool(std::move(*this));
+}
+
+Dot::Dot() : Object(ObjectType::kDot) {
+}
+
+Object* Dot::MoveTo(void* slot) {
+    return new (slot) Dot(std::move(*this));
+}
+
+Cell::Cell() : Object(ObjectType::kCell), cell_() {
+}
+
 Object* Cell::GetFirst() const {
     return cell_.first;
 }
@@ -50,32 +75,56 @@ Object* Cell::GetSecond() const {
     return cell_.second;
 }
 
-void Cell::Mark() {
-    if (marked_) {
-        return;
-    }
-    marked_ = true;
-    if (cell_.first) {
-        cell_.first->Mark();
-    }
-    if (cell_.second) {
-        cell_.second->Mark();
-    }
+void Cell::Trace(Tracer& tracer) {
+    tracer.Visit(cell_.first);
+    tracer.Visit(cell_.second);
 }
 
-Symbol::Symbol(std::string name) : name_(name){};
+Object* Cell::MoveTo(void* slot) {
+    return new (slot) Cell(std::move(*this));
+}
+
+Symbol::Symbol(const std::string& name)
+    : Object(ObjectType::kSymbol), id_(SymbolTable::Get().GetId(name)){};
+
+Symbol::Symbol(const std::string& name, ObjectType type)
+    : Object(type), id_(SymbolTable::Get().GetId(name)){};
+
+Symbol::Symbol(uint32_t id, ObjectType type) : Object(type), id_(id){};
 
 const std::string& Symbol::GetName() const {
-    return name_;
+    return SymbolTable::Get().GetName(id_);
+}
+
+Object* Symbol::MoveTo(void* slot) {
+    return new (slot) Symbol(std::move(*this));
 }
 
-Function::Function(const std::string& name) : Symbol(name){};
+LocalSymbol::LocalSymbol(uint32_t id, uint32_t depth, uint32_t slot)
+    : Symbol(id, ObjectType::kLocalSymbol), depth_(depth), slot_(slot){};
+
+Object* LocalSymbol::MoveTo(void* slot) {
+    return new (slot) LocalSymbol(std::move(*this));
+}
 
-Lambda::Lambda(const std::string& name, Object* args, Object* body, Object* scope)
-    : Function(name), args_(args), body_(body), scope_(scope){};
+GlobalSymbol::GlobalSymbol(uint32_t id) : Symbol(id, ObjectType::kGlobalSymbol), cell_(nullptr){};
 
-Object* Lambda::GetArgs() const {
-    return args_;
+Object* GlobalSymbol::MoveTo(void* slot) {
+    return new (slot) GlobalSymbol(std::move(*this));
+}
+
+Function::Function(const std::string& name, ObjectType type) : Symbol(name, type){};
+
+Lambda::Lambda(const std::string& name, Object* layout, Object* body, Object* scope)
+    : Function(name, ObjectType::kLambda), layout_(layout), body_(body), scope_(scope) {
+    auto& heap = Heap::GetHeap();
+    heap.WriteBarrier(this, layout_);
+    heap.WriteBarrier(this, body_);
+    heap.WriteBarrier(this, scope_);
+}
+
+Object* Lambda::GetLayout() const {
+    return layout_;
 }
 
 Object* Lambda::GetBody() const {
@@ -87,33 +136,70 @@ Object* Lambda::GetScope() const {
 }
 
 Object* Lambda::Call(Object* obj, Object* scope) {
-    auto res =
-        advanced::FEvalLambda(GetProperList(GetArgs(), GetName()), GetProperList(obj, GetName()),
-                              GetProperList(GetBody()), GetScope(), scope);
+    if (Object* body = As<FrameLayout>(GetLayout())->GetAnalyzedBody()) {
+        return advanced::FEvalLambda(GetLayout(), ProperList(obj, GetName()), body, GetScope(),
+                                     scope);
+    }
+    auto res = advanced::FEvalLambda(GetLayout(), ProperList(obj, GetName()),
+                                     ProperList(GetBody()), GetScope(), scope);
     return res;
 }
 
-void Lambda::Mark() {
-    if (marked_) {
-        return;
-    }
-    marked_ = true;
-    if (args_) {
-        args_->Mark();
+void Lambda::Trace(Tracer& tracer) {
+    tracer.Visit(layout_);
+    tracer.Visit(body_);
+    tracer.Visit(scope_);
+}
+
+Object* Lambda::MoveTo(void* slot) {
+    return new (slot) Lambda(std::move(*this));
+}
+
+Reserved::Reserved(const std::string& name, Special* special, size_t min_args, size_t max_args)
+    : Function(name, ObjectType::kReserved),
+      special_(special),
+      min_args_(min_args),
+      max_args_(max_args) {
+}
+
+Reserved::Reserved(const std::string& name, Primitive* primitive, size_t arg_count)
+    : Function(name, ObjectType::kReserved),
+      primitive_(primitive),
+      min_args_(arg_count),
+      max_args_(arg_count) {
+    ASSERT(arg_count >= 1 && arg_count <= kMaxPrimitiveArgs, "Unsupported primitive arity");
+}
+
+Object* Reserved::Call(Object* obj, Object* scope) {
+    if (special_) {
+        return special_(obj, scope);
     }
-    if (body_) {
-        body_->Mark();
+    ProperList args(obj, GetName());
+    if (!Accepts(args.size())) {
+        throw RuntimeError(GetName() + (min_args_ == 1 ? kMustOneArg : kMustTwoArg));
     }
-    if (scope_) {
-        scope_->Mark();
+    std::array<Object*, kMaxPrimitiveArgs> values = {};
+    Root first_root(values[0]);
+    Root second_root(values[1]);
+    size_t id = 0;
+    for (Object* arg : args) {
+        values[id++] = Eval(arg, scope);
     }
+    return primitive_(values.data());
 }
 
-Reserved::Reserved(const std::string& name, std::function<Signature> func)
-    : Function(name), func_(func) {
+Reserved::Evaluation Reserved::GetEvaluation() const {
+    return special_ ? Evaluation::kSpecial : Evaluation::kEvaluated;
 }
 
-Object* Reserved::Call(Object* obj, Object* scope) {
-    auto res = func_(obj, scope);
-    return res;
+Reserved::Primitive* Reserved::GetPrimitive() const {
+    return primitive_;
+}
+
+bool Reserved::Accepts(size_t argc) const {
+    return min_args_ <= argc && argc <= max_args_;
+}
+
+Object* Reserved::MoveTo(void* slot) {
+    return new (slot) Reserved(std::move(*this));
 }
@@ -2,65 +2,137 @@
 
 #include "object_fwd.h"
 
+#include "heap.h"
 #include "scope_fwd.h"
 
+#include <cstddef>
 #include <cstdint>
-#include <functional>
 #include <memory>
 #include <string>
 #include <type_traits>
 #include <vector>
 
+// Receives every object reference held by a traced object and marks it. Unmarked objects are put
+// onto an explicit work list instead of being traced recursively. An atomic tracer may run
+// concurrently with other tracers. An evacuating tracer moves unmarked objects out of the young
+// generation instead of marking them, rewrites the visited references and queues the copies.
+class Tracer {
+public:
+    enum class Mode { kMark, kMarkAtomic, kEvacuate };
+
+    Tracer(std::vector<Object*>* stack, Mode mode = Mode::kMark);
+
+    void Visit(Object*& slot);
+
+    // traces at most `budget` objects, returns true once the work list is empty
+    bool Drain(size_t budget = SIZE_MAX);
+
+private:
+    std::vector<Object*>* stack_;
+    Mode mode_;
+    // the first visited object is traced next without going through the stack,
+    // so the stack stays shallow while walking a list spine
+    Object* next_;
+};
+
+// Subclasses of a class have consecutive tags, so `Is` checks a tag range
+enum class ObjectType : uint8_t {
+    kNumber,
+    kBool,
+    kDot,
+    kCell,
+    kScope,
+    kFrameLayout,
+    kCode,
+    kAnalyzedBody,
+    kJitCode,
+    kSymbol,
+    kLocalSymbol,
+    kGlobalSymbol,
+    kLambda,
+    kReserved,
+};
+
 class Object {
     friend class Heap;
-    friend class Cell;
-    friend class Lambda;
-    friend class Scope;
+    friend class Tracer;
 
 public:
-    Object() = default;
+    static constexpr ObjectType kFirstType = ObjectType::kNumber;
+    static constexpr ObjectType kLastType = ObjectType::kReserved;
+
+    Object(ObjectType type);
     virtual ~Object() = default;
 
+    ObjectType GetType() const {
+        return type_;
+    }
+
 protected:
-    virtual void Mark();
-    virtual void UnMark();
-    virtual bool IsMarked();
+    // reports references to other objects, must not recurse into them
+    virtual void Trace(Tracer& tracer);
+    // moves the object into `slot`, which has the size of the object
+    virtual Object* MoveTo(void* slot) = 0;
 
-    bool marked_ = false;
+private:
+    ObjectType type_;
 };
 
 class Number : public Object {
 public:
-    Number() = default;
+    static constexpr ObjectType kFirstType = ObjectType::kNumber;
+    static constexpr ObjectType kLastType = ObjectType::kNumber;
+
+    Number();
     Number(int64_t val);
     ~Number() = default;
 
     int64_t GetValue() const;
 
+protected:
+    virtual Object* MoveTo(void* slot) override;
+
 private:
     int64_t value_;
 };
 
 class Bool : public Object {
 public:
-    Bool() = default;
+    static constexpr ObjectType kFirstType = ObjectType::kBool;
+    static constexpr ObjectType kLastType = ObjectType::kBool;
+
+    Bool();
     Bool(bool val);
     ~Bool() = default;
 
     bool GetValue() const;
     std::string GetName() const;
 
+protected:
+    virtual Object* MoveTo(void* slot) override;
+
 private:
     bool value_;
 };
 
 class Dot : public Object {
 public:
+    static constexpr ObjectType kFirstType = ObjectType::kDot;
+    static constexpr ObjectType kLastType = ObjectType::kDot;
+
+    Dot();
     ~Dot() = default;
+
+protected:
+    virtual Object* MoveTo(void* slot) override;
 };
 
 class Cell : public Object {
 public:
+    static constexpr ObjectType kFirstType = ObjectType::kCell;
+    static constexpr ObjectType kLastType = ObjectType::kCell;
+
+    Cell();
     Object* GetFirst() const;
     Object* GetSecond() const;
     ~Cell() = default;
@@ -68,79 +140,264 @@ public:
     template <class T>
     requires(std::is_base_of_v<Object, T>) void SetFirst(T* other) {
         cell_.first = other;
+        Heap::GetHeap().WriteBarrier(this, other);
     }
     template <class T>
     requires(std::is_base_of_v<Object, T>) void SetSecond(T* other) {
         cell_.second = other;
+        Heap::GetHeap().WriteBarrier(this, other);
     }
 
 protected:
-    virtual void Mark() override;
+    virtual void Trace(Tracer& tracer) override;
+    virtual Object* MoveTo(void* slot) override;
     std::pair<Object*, Object*> cell_;
 };
 
 class Symbol : public Object {
 public:
-    Symbol() = default;
-    Symbol(std::string name);
+    static constexpr ObjectType kFirstType = ObjectType::kSymbol;
+    static constexpr ObjectType kLastType = ObjectType::kReserved;
+
+    // prefer SymbolTable::Intern, which returns the canonical symbol with the name
+    Symbol(const std::string& name);
 
-    virtual const std::string& GetName() const;
+    const std::string& GetName() const;
+    uint32_t GetId() const {
+        return id_;
+    }
     virtual ~Symbol() = default;
 
+protected:
+    Symbol(const std::string& name, ObjectType type);
+    Symbol(uint32_t id, ObjectType type);
+    virtual Object* MoveTo(void* slot) override;
+
+private:
+    // id in the SymbolTable
+    uint32_t id_;
+};
+
+// Reference to a variable of a lambda frame, put into lambda bodies by Resolve in place of the
+// symbol. The variable lives in slot `slot` of the frame `depth` scopes up the chain.
+class LocalSymbol : public Symbol {
+public:
+    static constexpr ObjectType kFirstType = ObjectType::kLocalSymbol;
+    static constexpr ObjectType kLastType = ObjectType::kLocalSymbol;
+
+    LocalSymbol(uint32_t id, uint32_t depth, uint32_t slot);
+    ~LocalSymbol() = default;
+
+    uint32_t GetDepth() const {
+        return depth_;
+    }
+    uint32_t GetSlot() const {
+        return slot_;
+    }
+
+protected:
+    virtual Object* MoveTo(void* slot) override;
+
+private:
+    uint32_t depth_;
+    uint32_t slot_;
+};
+
+// Reference to a global variable, put into lambda bodies by Resolve in place of the symbol.
+// Caches the cell holding the variable in the global scope once the variable is defined. Cells
+// are never removed, so define and set! update the cached cell in place.
+class GlobalSymbol : public Symbol {
+public:
+    static constexpr ObjectType kFirstType = ObjectType::kGlobalSymbol;
+    static constexpr ObjectType kLastType = ObjectType::kGlobalSymbol;
+
+    GlobalSymbol(uint32_t id);
+    ~GlobalSymbol() = default;
+
+    Object** GetCell() const {
+        return cell_;
+    }
+    void SetCell(Object** cell) {
+        cell_ = cell;
+    }
+
+protected:
+    virtual Object* MoveTo(void* slot) override;
+
 private:
-    std::string name_;
+    Object** cell_;
 };
 
 class Function : public Symbol {
 public:
-    Function(const std::string& name);
+    static constexpr ObjectType kFirstType = ObjectType::kLambda;
+    static constexpr ObjectType kLastType = ObjectType::kReserved;
+
     virtual ~Function() = default;
 
     virtual Object* Call(Object* obj, Object* scope) = 0;
+
+protected:
+    Function(const std::string& name, ObjectType type);
 };
 
 class Lambda : public Function {
     using Signature = Object*(Object*, Object*);
 
 public:
-    Lambda(const std::string& name, Object* args, Object* body, Object* scope);
+    static constexpr ObjectType kFirstType = ObjectType::kLambda;
+    static constexpr ObjectType kLastType = ObjectType::kLambda;
+
+    // `layout` is the FrameLayout of the frames created by calls
+    Lambda(const std::string& name, Object* layout, Object* body, Object* scope);
     ~Lambda() = default;
 
-    Object* GetArgs() const;
+    Object* GetLayout() const;
     Object* GetBody() const;
     Object* GetScope() const;
     Object* Call(Object* obj, Object* scope) override;
 
 protected:
-    virtual void Mark() override;
-    Object* args_;
+    virtual void Trace(Tracer& tracer) override;
+    virtual Object* MoveTo(void* slot) override;
+    Object* layout_;
     Object* body_;
     Object* scope_;
 };
 
+// Builtin function. A special form receives its arguments unevaluated together with the calling
+// scope and checks them itself. A primitive takes a fixed number of arguments: Call checks the
+// count, evaluates them left to right and passes the values, so callers that have already
+// evaluated the arguments may call the primitive directly.
 class Reserved : public Function {
-    using Signature = Object*(Object*, Object*);
-
 public:
-    Reserved(const std::string& name, std::function<Signature> func);
+    using Special = Object*(Object* args, Object* scope);
+    using Primitive = Object*(Object* const* args);
+
+    enum class Evaluation { kSpecial, kEvaluated };
+
+    static constexpr ObjectType kFirstType = ObjectType::kReserved;
+    static constexpr ObjectType kLastType = ObjectType::kReserved;
+    static constexpr size_t kVariadic = SIZE_MAX;
+    static constexpr size_t kMaxPrimitiveArgs = 2;
+
+    Reserved(const std::string& name, Special* special, size_t min_args, size_t max_args);
+    Reserved(const std::string& name, Primitive* primitive, size_t arg_count);
     Object* Call(Object* obj, Object* scope) override;
     ~Reserved() = default;
 
+    Evaluation GetEvaluation() const;
+    // nullptr for a special form
+    Primitive* GetPrimitive() const;
+    // whether a call with `argc` arguments gets past the arity check
+    bool Accepts(size_t argc) const;
+
+protected:
+    virtual Object* MoveTo(void* slot) override;
+
 private:
-    std::function<Signature> func_;
+    Special* special_ = nullptr;
+    Primitive* primitive_ = nullptr;
+    size_t min_args_;
+    size_t max_args_;
 };
 
 //---------------------------------------------------------------------
 
-template <class T>
-requires(std::is_base_of_v<Object, T>) T* As(Object* obj) {
-    return dynamic_cast<T*>(obj);
+// Small integers and booleans are immediates: they are encoded in the object pointer itself and
+// never touch the heap. Heap objects are 16-byte aligned, so their two low bits are zero.
+// A fixnum keeps its value in the upper 63 bits and has the lowest bit set, a boolean keeps its
+// value in bit 2 and has the low bits equal to 0b10. The empty list is nullptr.
+inline constexpr uintptr_t kFixnumTag = 1;
+inline constexpr uintptr_t kBoolTag = 2;
+inline constexpr uintptr_t kImmediateMask = 3;
+inline constexpr int64_t kMaxFixnum = INT64_MAX >> 1;
+inline constexpr int64_t kMinFixnum = INT64_MIN >> 1;
+
+inline bool IsHeapObject(const Object* obj) {
+    return obj && !(reinterpret_cast<uintptr_t>(obj) & kImmediateMask);
+}
+
+// `obj` must not be nullptr
+inline ObjectType GetObjectType(const Object* obj) {
+    auto raw = reinterpret_cast<uintptr_t>(obj);
+    if (raw & kFixnumTag) {
+        return ObjectType::kNumber;
+    }
+    if (raw & kBoolTag) {
+        return ObjectType::kBool;
+    }
+    return obj->GetType();
+}
+
+inline void Tracer::Visit(Object*& slot) {
+    if (!IsHeapObject(slot)) {
+        return;
+    }
+    if (mode_ == Mode::kEvacuate) {
+        slot = Heap::GetHeap().Evacuate(slot, stack_);
+        return;
+    }
+    Slab* slab = Slab::Of(slot);
+    if (mode_ == Mode::kMarkAtomic ? slab->MarkAtomic(slot) : slab->Mark(slot)) {
+        if (next_) {
+            stack_->push_back(slot);
+        } else {
+            next_ = slot;
+        }
+    }
 }
 
 template <class T>
 requires(std::is_base_of_v<Object, T>) bool Is(Object* obj) {
-    if (dynamic_cast<T*>(obj)) {
-        return true;
+    return obj && GetObjectType(obj) >= T::kFirstType && GetObjectType(obj) <= T::kLastType;
+}
+
+// numbers and booleans may be immediates, use GetNumberValue and GetBoolValue for them
+template <class T>
+requires(std::is_base_of_v<Object, T> && !std::is_same_v<T, Number> &&
+         !std::is_same_v<T, Bool>) T* As(Object* obj) {
+    if (Is<T>(obj)) {
+        return static_cast<T*>(obj);
+    }
+    return nullptr;
+}
+
+// returns an immediate if the value fits into a fixnum, a heap Number otherwise
+inline Object* MakeNumber(int64_t value) {
+    if (value < kMinFixnum || value > kMaxFixnum) {
+        return Heap::GetHeap().Make<Number>(value);
+    }
+    return reinterpret_cast<Object*>((static_cast<uintptr_t>(value) << 1) | kFixnumTag);
+}
+
+inline Object* MakeBool(bool value) {
+    return reinterpret_cast<Object*>((static_cast<uintptr_t>(value) << 2) | kBoolTag);
+}
+
+inline bool IsFixnum(const Object* obj) {
+    return reinterpret_cast<uintptr_t>(obj) & kFixnumTag;
+}
+
+// `obj` must be a fixnum
+inline int64_t GetFixnumValue(const Object* obj) {
+    return static_cast<int64_t>(reinterpret_cast<uintptr_t>(obj)) >> 1;
+}
+
+// `obj` must be a number
+inline int64_t GetNumberValue(Object* obj) {
+    auto raw = reinterpret_cast<uintptr_t>(obj);
+    if (raw & kFixnumTag) {
+        return static_cast<int64_t>(raw) >> 1;
+    }
+    return static_cast<Number*>(obj)->GetValue();
+}
+
+// `obj` must be a boolean
+inline bool GetBoolValue(Object* obj) {
+    auto raw = reinterpret_cast<uintptr_t>(obj);
+    if (raw & kBoolTag) {
+        return raw >> 2;
     }
-    return false;
+    return static_cast<Bool*>(obj)->GetValue();
 }
@@ -1,3 +1,4 @@
 #pragma once
 
-class Object;
\ No newline at end of file
+class Object;
+class Tracer;
\ No newline at end of file
@@ -0,0 +1,86 @@
+#include "parallel.h"
+
+#include "object.h"
+
+#include <algorithm>
+
+ParallelMarker::ParallelMarker(size_t threads) : threads_(threads), deques_(threads), idle_(0) {
+}
+
+void ParallelMarker::Run(std::vector<Object*>* work) {
+    for (size_t id = 0; id < work->size(); ++id) {
+        auto& deque = deques_[id % threads_];
+        deque.items.push_back((*work)[id]);
+        ++deque.size;
+    }
+    work->clear();
+    RunParallel(threads_, [this](size_t id) { Work(id); });
+}
+
+void ParallelMarker::Work(size_t id) {
+    std::vector<Object*> stack;
+    Tracer tracer(&stack, Tracer::Mode::kMarkAtomic);
+    while (true) {
+        if (!tracer.Drain(kBatch)) {
+            Share(id, &stack);
+            continue;
+        }
+        if (Take(id, &stack)) {
+            continue;
+        }
+        if (!WaitForWork()) {
+            return;
+        }
+    }
+}
+
+void ParallelMarker::Share(size_t id, std::vector<Object*>* stack) {
+    auto& deque = deques_[id];
+    if (stack->size() <= kShareSize || deque.size.load(std::memory_order_relaxed)) {
+        return;
+    }
+    // the bottom of the stack holds the objects pushed first, they tend to have larger subgraphs
+    auto middle = stack->begin() + stack->size() / 2;
+    std::lock_guard lock(deque.mutex);
+    deque.items.insert(deque.items.end(), stack->begin(), middle);
+    deque.size = deque.items.size();
+    stack->erase(stack->begin(), middle);
+}
+
+bool ParallelMarker::Take(size_t id, std::vector<Object*>* stack) {
+    for (size_t step = 0; step < threads_; ++step) {
+        if (Steal(deques_[(id + step) % threads_], stack)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ParallelMarker::Steal(Deque& deque, std::vector<Object*>* stack) {
+    if (!deque.size.load(std::memory_order_relaxed)) {
+        return false;
+    }
+    std::lock_guard lock(deque.mutex);
+    size_t count = (deque.items.size() + 1) / 2;
+    stack->insert(stack->end(), deque.items.begin(), deque.items.begin() + count);
+    deque.items.erase(deque.items.begin(), deque.items.begin() + count);
+    deque.size = deque.items.size();
+    return count > 0;
+}
+
+bool ParallelMarker::WaitForWork() {
+    // a thread becomes idle only after it found its own deque empty, and only the owner fills
+    // a deque, so once all threads are idle no work is left anywhere
+    ++idle_;
+    while (idle_.load() != threads_) {
+        bool has_work = std::any_of(deques_.begin(), deques_.end(), [](const Deque& deque) {
+            return deque.size.load(std::memory_order_relaxed) > 0;
+        });
+        if (has_work) {
+            --idle_;
+            return true;
+        }
+        std::this_thread::yield();
+    }
+    return false;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "object_fwd.h"
+
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Calls `func(id)` for every id in [0, threads), each on its own thread. The calling thread
+// runs id 0.
+template <class F>
+void RunParallel(size_t threads, F func) {
+    std::vector<std::thread> workers;
+    for (size_t id = 1; id < threads; ++id) {
+        workers.emplace_back(func, id);
+    }
+    func(0);
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+// Marks everything reachable from a work list with several threads. Every thread traces from a
+// private stack and publishes the oldest half of it to its own deque when the deque runs dry.
+// Threads without work steal from the deques of others.
+class ParallelMarker {
+public:
+    ParallelMarker(size_t threads);
+    ParallelMarker(const ParallelMarker& other) = delete;
+    ParallelMarker& operator=(const ParallelMarker& other) = delete;
+
+    // objects in `work` must be marked already, the list is empty afterwards
+    void Run(std::vector<Object*>* work);
+
+private:
+    // objects traced between two checks of the deques
+    static constexpr size_t kBatch = 128;
+    // a private stack is shared only when it holds more objects
+    static constexpr size_t kShareSize = 32;
+
+    struct Deque {
+        std::mutex mutex;
+        std::deque<Object*> items;
+        std::atomic<size_t> size = 0;
+    };
+
+    void Work(size_t id);
+    void Share(size_t id, std::vector<Object*>* stack);
+    bool Take(size_t id, std::vector<Object*>* stack);
+    bool Steal(Deque& deque, std::vector<Object*>* stack);
+    // returns false once every thread is out of work
+    bool WaitForWork();
+
+    size_t threads_;
+    std::vector<Deque> deques_;
+    std::atomic<size_t> idle_;
+};
@@ -6,6 +6,7 @@
 #include "object.h"
 #include "scheme.h"
 #include "heap.h"
+#include "symbol_table.h"
 
 #include <memory>
 #include <variant>
@@ -23,10 +24,11 @@ Object* GetObjectByList(std::vector<Object*>& list) {
     } else if (Is<Dot>(list.back())) {
         throw SyntaxError("Dot can't be last symbol in list\n" + kDotPositionHelp);
     }
-    Cell* to_retern = As<Cell>(Heap::GetHeap().Make<Cell>());
-    to_retern->SetFirst(list[0]);
+    Object* to_retern = Heap::GetHeap().Make<Cell>();
+    Root to_retern_root(to_retern);
+    As<Cell>(to_retern)->SetFirst(list[0]);
 
-    auto cur(to_retern);
+    auto cur = As<Cell>(to_retern);
     for (size_t id = 1; id < list.size(); ++id) {
         if (Is<Dot>(list[id])) {
             if (id + 2 != list.size()) {
@@ -55,21 +57,21 @@ Object* Read(Tokenizer* tokenizer) {
     tokenizer->Next();
 
     if (ConstantToken* ptr = std::get_if<ConstantToken>(&token)) {
-        return Heap::GetHeap().Make<Number>(ptr->value);
+        return MakeNumber(ptr->value);
     }
     if (BooleanToken* ptr = std::get_if<BooleanToken>(&token)) {
-        return Heap::GetHeap().Make<Bool>(*ptr == BooleanToken::TRUE);
+        return MakeBool(*ptr == BooleanToken::TRUE);
     }
     if (std::get_if<DotToken>(&token)) {
         return Heap::GetHeap().Make<Dot>();
     }
     if (SymbolToken* ptr = std::get_if<SymbolToken>(&token)) {
-        auto name = ptr->name;
-        return Heap::GetHeap().Make<Symbol>(name);
+        return SymbolTable::Get().Intern(ptr->name);
     }
     if (std::get_if<QuoteToken>(&token)) {
         Object* obj = Heap::GetHeap().Make<Cell>();
-        As<Cell>(obj)->SetFirst(Heap::GetHeap().Make<Symbol>(kQuote));
+        Root obj_root(obj);
+        As<Cell>(obj)->SetFirst(SymbolTable::Get().Intern(kQuote));
         As<Cell>(obj)->SetSecond(Heap::GetHeap().Make<Cell>());
         As<Cell>(As<Cell>(obj)->GetSecond())->SetFirst(Read(tokenizer));
         if (Is<Dot>(As<Cell>(As<Cell>(obj)->GetSecond())->GetFirst())) {
@@ -83,6 +85,7 @@ Object* Read(Tokenizer* tokenizer) {
 
 Object* ReadList(Tokenizer* tokenizer) {
     std::vector<Object*> list;
+    RootList list_root(list);
 
     {
         auto token = tokenizer->GetToken();
@@ -9,6 +9,8 @@
 const std::string kHelp = "!help";
 const std::string kBenchOn = "!benchon";
 const std::string kBenchOff = "!benchoff";
+const std::string kBytecodeOn = "!bytecodeon";
+const std::string kBytecodeOff = "!bytecodeoff";
 const std::string kExit = "!exit";
 
 const std::string kDelim = "─────────────────────\n";
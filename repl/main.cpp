@@ -25,6 +25,8 @@ BeautyHelp help;
 void HelpMessage() {
     std::cout << "\n";
     std::cout << "Type \'!benchon\' to turn in benching mode and \'!benchoff\' to disable it\n";
+    std::cout << "Type \'!bytecodeon\' to run commands on the bytecode VM and \'!bytecodeoff\' to "
+                 "walk the tree again\n";
     std::cout << "Type \'!help\' to see help message\n";
     std::cout << "Type \'!exit\' to end interpreter work\n";
     std::cout << "\n";
@@ -54,6 +56,12 @@ int main() {
             } else if (RemoveSpaces(line) == kBenchOff) {
                 benching = false;
                 std::cout << "Benching mode: OFF\n";
+            } else if (RemoveSpaces(line) == kBytecodeOn) {
+                scheme.SetEvaluator(Evaluator::kBytecode);
+                std::cout << "Bytecode mode: ON\n";
+            } else if (RemoveSpaces(line) == kBytecodeOff) {
+                scheme.SetEvaluator(Evaluator::kTree);
+                std::cout << "Bytecode mode: OFF\n";
             } else if (RemoveSpaces(line) == kExit) {
                 exit(0);
             }
@@ -0,0 +1,424 @@
+#include "resolver.h"
+
+#include "constants.h"
+#include "error.h"
+#include "heap.h"
+#include "object.h"
+#include "scheme.h"
+#include "scope.h"
+#include "symbol_table.h"
+
+#include <cstdint>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace {
+
+Object* GetGlobalScope(Object* scope) {
+    while (As<Scope>(scope)->GetPrevScope()) {
+        scope = As<Scope>(scope)->GetPrevScope();
+    }
+    return scope;
+}
+
+// whether a call of the global variable may assign a variable of the calling frame that Resolve
+// does not see assigned: set! and define do so under any other name
+bool IsHiddenMutator(uint32_t name, Object* global) {
+    static Object* const kSetBuiltin = FindBuiltin(SymbolTable::Get().GetId(kSet));
+    static Object* const kDefineBuiltin = FindBuiltin(SymbolTable::Get().GetId(kDefine));
+    Object* value;
+    try {
+        value = As<Scope>(global)->GetObject(name);
+    } catch (const NameError&) {
+        return false;
+    }
+    return (value == kSetBuiltin || value == kDefineBuiltin) && As<Symbol>(value)->GetId() != name;
+}
+
+// whether the variable of the slot of frames with the layout is still immutable. A global
+// variable the body calls may have become set! or define under another name since the layout
+// was converted, then no variable of the layout is immutable from now on
+bool IsImmutable(FrameLayout* layout, uint32_t slot, Object* global) {
+    if (!layout->IsImmutable(slot)) {
+        return false;
+    }
+    if (layout->GetEpoch() == Scope::GetBuiltinEpoch()) {
+        return true;
+    }
+    bool immutable = !Scope::HasDynamicFrames();
+    for (uint32_t name : layout->GetCallees()) {
+        immutable = immutable && !IsHiddenMutator(name, global);
+    }
+    if (!immutable) {
+        layout->SetImmutable(std::vector<bool>(layout->GetSlotCount(), false));
+        return false;
+    }
+    layout->SetEpoch(Scope::GetBuiltinEpoch());
+    return true;
+}
+
+class Resolver {
+public:
+    Resolver(Object* scope)
+        : scope_(scope),
+          define_(SymbolTable::Get().GetId(kDefine)),
+          lambda_(SymbolTable::Get().GetId(kLambda)),
+          quote_(SymbolTable::Get().GetId(kQuote)),
+          set_(SymbolTable::Get().GetId(kSet)) {
+    }
+
+    // names of the frame: arguments first, then the variables defined in the body
+    std::vector<uint32_t> CollectNames(Object* params, Object* body) {
+        std::vector<uint32_t> names;
+        for (; Is<Cell>(params); params = As<Cell>(params)->GetSecond()) {
+            names.push_back(As<Symbol>(As<Cell>(params)->GetFirst())->GetId());
+        }
+        CollectDefines(body, &names);
+        return names;
+    }
+
+    // marks the immutable variables of the lambda and decides whether it is flat, see Capture
+    void Convert(Object* body, FrameLayout* layout) {
+        CollectSymbols(body);
+        // closures made through another name for lambda are caught by Scope::MarkCaptured
+        layout->SetMayEscape(creates_closures_ || seen_.contains(lambda_));
+        if (Scope::HasDynamicFrames()) {
+            return;
+        }
+        Object* global = GetGlobalScope(scope_);
+        std::vector<uint32_t> callees;
+        bool known_calls = CallsOnlyGlobals(layout, global, &callees);
+        std::vector<bool> immutable(layout->GetSlotCount(), false);
+        for (uint32_t slot = 0; known_calls && slot < layout->GetArgCount(); ++slot) {
+            uint32_t name = layout->GetName(slot);
+            immutable[slot] = layout->FindSlot(name) == slot && !assigned_.contains(name);
+        }
+        layout->SetImmutable(std::move(immutable));
+        layout->SetCallees(callees);
+        layout->SetEpoch(Scope::GetBuiltinEpoch());
+        std::vector<CapturedVariable> captures;
+        std::vector<uint32_t> names;
+        for (uint32_t name : referenced_) {
+            // arguments are bound for the whole call
+            uint32_t own = layout->FindSlot(name);
+            if (own != FrameLayout::kNoSlot && own < layout->GetArgCount()) {
+                continue;
+            }
+            uint32_t depth = 0;
+            for (Object* scope = scope_; As<Scope>(scope)->GetLayout(); ++depth) {
+                auto frame_layout = As<FrameLayout>(As<Scope>(scope)->GetLayout());
+                if (uint32_t slot = frame_layout->FindSlot(name); slot != FrameLayout::kNoSlot) {
+                    if (!IsImmutable(frame_layout, slot, global)) {
+                        return;
+                    }
+                    captures.push_back({depth, slot, name});
+                    names.push_back(name);
+                    break;
+                }
+                scope = As<Scope>(scope)->GetPrevScope();
+            }
+        }
+        if (IsWholeFrame(captures)) {
+            return;
+        }
+        Object* capture_layout = nullptr;
+        if (!captures.empty()) {
+            capture_layout =
+                Heap::GetHeap().Make<FrameLayout>(nullptr, nullptr, names, names.size());
+            // the copies may only change by calls of the body
+            auto copies = As<FrameLayout>(capture_layout);
+            copies->SetImmutable(std::vector<bool>(names.size(), known_calls));
+            copies->SetCallees(std::move(callees));
+            copies->SetEpoch(Scope::GetBuiltinEpoch());
+        }
+        layout->SetCaptures(capture_layout, std::move(captures));
+    }
+
+    // `scope` is where the closure lives, see Capture
+    void ResolveBody(Object* body, const FrameLayout* layout, Object* scope) {
+        scope_ = scope;
+        layout_ = layout;
+        ResolveList(body);
+    }
+
+private:
+    bool IsForm(Object* obj, uint32_t head) const {
+        return Is<Cell>(obj) && Is<Symbol>(As<Cell>(obj)->GetFirst()) &&
+               As<Symbol>(As<Cell>(obj)->GetFirst())->GetId() == head;
+    }
+
+    // a lambda created already has its FrameLayout in place of the argument list
+    bool IsOpaque(Cell* form) const {
+        if (IsForm(form, quote_) || IsForm(form, lambda_)) {
+            return true;
+        }
+        auto rest = form->GetSecond();
+        return Is<Cell>(rest) && Is<FrameLayout>(As<Cell>(rest)->GetFirst());
+    }
+
+    // `(define (name args) body)` is a lambda in disguise
+    bool IsDefinePrototype(Cell* form) const {
+        auto rest = form->GetSecond();
+        return IsForm(form, define_) && Is<Cell>(rest) && Is<Cell>(As<Cell>(rest)->GetFirst());
+    }
+
+    void CollectDefines(Object* forms, std::vector<uint32_t>* names) {
+        for (; Is<Cell>(forms); forms = As<Cell>(forms)->GetSecond()) {
+            auto form = As<Cell>(forms)->GetFirst();
+            if (!Is<Cell>(form) || IsOpaque(As<Cell>(form))) {
+                continue;
+            }
+            if (IsForm(form, define_) && Is<Cell>(As<Cell>(form)->GetSecond())) {
+                auto target = As<Cell>(As<Cell>(form)->GetSecond())->GetFirst();
+                if (Is<Cell>(target)) {
+                    target = As<Cell>(target)->GetFirst();
+                }
+                if (Is<Symbol>(target)) {
+                    names->push_back(As<Symbol>(target)->GetId());
+                }
+                if (IsDefinePrototype(As<Cell>(form))) {
+                    continue;
+                }
+            }
+            CollectDefines(form, names);
+        }
+    }
+
+    // whether the captures are all the variables of the frame the lambda is created in, and the
+    // frame refers to nothing but the global scope: keeping the frame costs no more than a copy
+    bool IsWholeFrame(const std::vector<CapturedVariable>& captures) const {
+        if (captures.empty()) {
+            return false;
+        }
+        auto frame_layout = As<FrameLayout>(As<Scope>(scope_)->GetLayout());
+        if (!frame_layout->IsFlat() || frame_layout->GetCaptureLayout() ||
+            captures.size() != frame_layout->GetSlotCount()) {
+            return false;
+        }
+        for (const auto& capture : captures) {
+            if (capture.depth) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // names the body may refer to, names it may set!, names it binds and the heads of its calls,
+    // quoted data aside
+    void CollectSymbols(Object* list) {
+        Object* obj = list;
+        for (; Is<Cell>(obj); obj = As<Cell>(obj)->GetSecond()) {
+            auto elem = As<Cell>(obj)->GetFirst();
+            if (Is<Cell>(elem)) {
+                CollectForm(As<Cell>(elem));
+            } else {
+                CollectSymbol(elem);
+            }
+        }
+        CollectSymbol(obj);
+    }
+
+    void CollectForm(Cell* form) {
+        if (IsForm(form, quote_)) {
+            return;
+        }
+        auto head = form->GetFirst();
+        if (Is<Symbol>(head) && !Is<Function>(head)) {
+            heads_.push_back(As<Symbol>(head)->GetId());
+        } else if (Is<Cell>(head) && !IsForm(head, lambda_)) {
+            unknown_head_ = true;
+        }
+        auto rest = form->GetSecond();
+        if (IsForm(form, set_) && Is<Cell>(rest)) {
+            auto target = As<Cell>(rest)->GetFirst();
+            if (Is<Symbol>(target)) {
+                assigned_.insert(As<Symbol>(target)->GetId());
+            }
+        }
+        if (IsDefinePrototype(form)) {
+            creates_closures_ = true;
+        }
+        // argument lists and prototypes are no calls
+        if ((IsForm(form, lambda_) || IsForm(form, define_)) && Is<Cell>(rest)) {
+            auto params = As<Cell>(rest)->GetFirst();
+            if (Is<FrameLayout>(params)) {
+                params = As<FrameLayout>(params)->GetParams();
+            }
+            CollectSymbol(head);
+            if (Is<Cell>(params)) {
+                CollectBound(params);
+                CollectSymbols(params);
+            } else {
+                if (auto name = As<Symbol>(params)) {
+                    bound_.insert(name->GetId());
+                }
+                CollectSymbol(params);
+            }
+            CollectSymbols(As<Cell>(rest)->GetSecond());
+            return;
+        }
+        CollectSymbols(form);
+    }
+
+    void CollectBound(Object* names) {
+        for (; Is<Cell>(names); names = As<Cell>(names)->GetSecond()) {
+            if (auto name = As<Symbol>(As<Cell>(names)->GetFirst())) {
+                bound_.insert(name->GetId());
+            }
+        }
+    }
+
+    // whether every call of the body is a call of a global variable, lambda expressions aside,
+    // and none of the variables is set! or define under another name. Other calls may assign any
+    // variable of the frame, see Capture. Stores the variables in `callees`
+    bool CallsOnlyGlobals(const FrameLayout* layout, Object* global,
+                          std::vector<uint32_t>* callees) const {
+        if (unknown_head_) {
+            return false;
+        }
+        std::unordered_set<uint32_t> seen;
+        for (uint32_t name : heads_) {
+            if (!seen.insert(name).second) {
+                continue;
+            }
+            if (bound_.contains(name) || layout->FindSlot(name) != FrameLayout::kNoSlot ||
+                IsHiddenMutator(name, global)) {
+                return false;
+            }
+            for (Object* scope = scope_; As<Scope>(scope)->GetLayout();
+                 scope = As<Scope>(scope)->GetPrevScope()) {
+                if (As<FrameLayout>(As<Scope>(scope)->GetLayout())->FindSlot(name) !=
+                    FrameLayout::kNoSlot) {
+                    return false;
+                }
+            }
+            callees->push_back(name);
+        }
+        return true;
+    }
+
+    void CollectSymbol(Object* obj) {
+        if (Is<Symbol>(obj) && !Is<Function>(obj)) {
+            uint32_t name = As<Symbol>(obj)->GetId();
+            if (seen_.insert(name).second) {
+                referenced_.push_back(name);
+            }
+        }
+    }
+
+    void ResolveForm(Cell* form) {
+        if (!IsOpaque(form) && !IsDefinePrototype(form)) {
+            ResolveList(form);
+        }
+    }
+
+    void ResolveList(Object* list) {
+        for (Object* obj = list; Is<Cell>(obj); obj = As<Cell>(obj)->GetSecond()) {
+            auto cell = As<Cell>(obj);
+            auto elem = cell->GetFirst();
+            if (Is<Cell>(elem)) {
+                ResolveForm(As<Cell>(elem));
+            } else if (Is<Symbol>(elem) && !Is<Function>(elem)) {
+                cell->SetFirst(ResolveSymbol(As<Symbol>(elem)));
+            }
+        }
+    }
+
+    Object* ResolveSymbol(Symbol* symbol) {
+        uint32_t name = symbol->GetId();
+        uint32_t depth = 0;
+        uint32_t slot = layout_->FindSlot(name);
+        for (Object* scope = scope_; slot == FrameLayout::kNoSlot; ++depth) {
+            if (!As<Scope>(scope)->GetLayout()) {
+                if (Is<GlobalSymbol>(symbol)) {
+                    return symbol;
+                }
+                return Heap::GetHeap().Make<GlobalSymbol>(name);
+            }
+            slot = As<FrameLayout>(As<Scope>(scope)->GetLayout())->FindSlot(name);
+            scope = As<Scope>(scope)->GetPrevScope();
+        }
+        if (auto local = As<LocalSymbol>(symbol)) {
+            if (local->GetDepth() == depth && local->GetSlot() == slot) {
+                return local;
+            }
+        }
+        return Heap::GetHeap().Make<LocalSymbol>(name, depth, slot);
+    }
+
+    Object* scope_;
+    const FrameLayout* layout_ = nullptr;
+    uint32_t define_;
+    uint32_t lambda_;
+    uint32_t quote_;
+    uint32_t set_;
+    std::vector<uint32_t> referenced_;
+    std::unordered_set<uint32_t> seen_;
+    std::unordered_set<uint32_t> assigned_;
+    // names bound by nested lambdas and definitions
+    std::unordered_set<uint32_t> bound_;
+    std::vector<uint32_t> heads_;
+    bool unknown_head_ = false;
+    bool creates_closures_ = false;
+};
+
+}  // namespace
+
+Object* Resolve(Object* params, Object* body, Object* scope) {
+    Resolver resolver(scope);
+    auto names = resolver.CollectNames(params, body);
+    size_t arg_count = 0;
+    for (Object* arg = params; Is<Cell>(arg); arg = As<Cell>(arg)->GetSecond()) {
+        ++arg_count;
+    }
+    Object* layout = Heap::GetHeap().Make<FrameLayout>(params, body, std::move(names), arg_count);
+    Root layout_root(layout);
+    resolver.Convert(body, As<FrameLayout>(layout));
+    Object* closure_scope = Capture(layout, scope);
+    Root closure_scope_root(closure_scope);
+    resolver.ResolveBody(body, As<FrameLayout>(layout), closure_scope);
+    return layout;
+}
+
+Object* Capture(Object* layout, Object* scope) {
+    auto frame_layout = As<FrameLayout>(layout);
+    if (!frame_layout->IsFlat()) {
+        return scope;
+    }
+    Object* global = GetGlobalScope(scope);
+    const auto& captures = frame_layout->GetCaptures();
+    if (captures.empty()) {
+        return global;
+    }
+    bool copy = true;
+    for (const auto& [depth, frame_slot, name] : captures) {
+        Object* frame = scope;
+        for (uint32_t up = 0; up < depth; ++up) {
+            frame = As<Scope>(frame)->GetPrevScope();
+        }
+        copy = copy && IsImmutable(As<FrameLayout>(As<Scope>(frame)->GetLayout()), frame_slot,
+                                   global);
+    }
+    if (!copy) {
+        // a variable may change after all: the frame of the closure keeps its slots unbound, so
+        // the variables are looked up by name in the scope the closure is created in
+        std::vector<uint32_t> names;
+        for (const auto& capture : captures) {
+            names.push_back(capture.name);
+        }
+        Object* lookup_layout =
+            Heap::GetHeap().Make<FrameLayout>(nullptr, nullptr, names, names.size());
+        Root lookup_layout_root(lookup_layout);
+        As<Scope>(scope)->MarkCaptured();
+        return Heap::GetHeap().Make<Scope>(scope, lookup_layout);
+    }
+    Object* closure_scope =
+        Heap::GetHeap().Make<Scope>(global, frame_layout->GetCaptureLayout());
+    for (uint32_t slot = 0; slot < captures.size(); ++slot) {
+        const auto& [depth, frame_slot, name] = captures[slot];
+        As<Scope>(closure_scope)->SetSlot(slot,
+                                          As<Scope>(scope)->GetLocal(depth, frame_slot, name));
+    }
+    return closure_scope;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "object_fwd.h"
+
+// Lexical addressing of lambda bodies. Every variable of the lambda gets a slot in its frames,
+// and every reference in `body` to a variable of the lambda or of the frames of `scope` is
+// replaced with a LocalSymbol holding the frame depth and the slot, every other reference with a
+// GlobalSymbol. Returns the FrameLayout.
+// Quoted data and nested lambdas are left alone, nested lambdas are resolved when they are
+// created. Resolve only has to be conservative: a reference it leaves as a symbol is looked up by
+// name, and a slot it reserves for a variable that is never defined stays unbound and defers to
+// the enclosing scopes.
+Object* Resolve(Object* params, Object* body, Object* scope);
+
+// Flat closure conversion. A lambda is flat if every variable of the enclosing frames its body
+// may refer to, nested lambdas included, is an argument that is never set!, or a variable of an
+// enclosing flat closure. Resolve then addresses those variables in the frame of the closure,
+// which holds copies of them, so the closure does not keep the enclosing frames alive. Other
+// lambdas, lambdas first created while frames hold names outside of their slots and lambdas that
+// capture every variable of a frame of a flat lambda keep the scope they are created in.
+// Another name for set! or define may assign any variable, so arguments only count as never set!
+// while every call in the body of their lambda is a call of a global variable holding neither.
+// Once one does, closures created from then on look the variables up by name in the scope they
+// are created in instead of copying them.
+// Returns the scope of a closure of the lambda with `layout` created in `scope`.
+Object* Capture(Object* layout, Object* scope);
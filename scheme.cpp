@@ -3,29 +3,49 @@
 #include "assertions.h"
 #include "basics.h"
 #include "advanced.h"
+#include "compiler.h"
 #include "constants.h"
 #include "error.h"
 #include "heap.h"
 #include "helpers.h"
+#include "jit.h"
 #include "object.h"
 #include "parser.h"
 #include "scope.h"
+#include "stack_limit.h"
+#include "symbol_table.h"
 #include "tokenizer.h"
 
+#include <sys/resource.h>
+#include <algorithm>
 #include <sstream>
 #include <string>
+#include <unordered_map>
 #include <variant>
 #include <vector>
 
 namespace {
 
+// most of the native stack, leaving room for the frames below the last check. The stack is capped
+// since an unlimited one still runs into other mappings
+size_t GetDefaultStackLimit() {
+    constexpr size_t kMaxStack = 64 << 20;
+    constexpr size_t kFallbackStack = 8 << 20;
+    rlimit limit;
+    size_t stack = kFallbackStack;
+    if (getrlimit(RLIMIT_STACK, &limit) == 0) {
+        stack = std::min<size_t>(limit.rlim_cur, kMaxStack);
+    }
+    return stack / 8 * 7;
+}
+
 void ToTokens(std::vector<Token>& tokens, Object* obj) {
     if (Is<Number>(obj)) {
-        tokens.emplace_back(SymbolToken{std::to_string(As<Number>(obj)->GetValue())});
+        tokens.emplace_back(SymbolToken{std::to_string(GetNumberValue(obj))});
         return;
     }
     if (Is<Bool>(obj)) {
-        tokens.emplace_back(SymbolToken{As<Bool>(obj)->GetName()});
+        tokens.emplace_back(SymbolToken{GetBoolValue(obj) ? kTrue : kFalse});
         return;
     }
     if (Is<Symbol>(obj)) {
@@ -33,6 +53,8 @@ void ToTokens(std::vector<Token>& tokens, Object* obj) {
         return;
     }
     ASSERT(!Is<Dot>(obj), "We must not meet dot object there");
+    // nested lists are printed recursively
+    StackLimit::Check();
     bool is_proper = CheckProperList(obj);
     auto list = GetList(obj);
     tokens.emplace_back(BracketToken::OPEN);
@@ -96,26 +118,38 @@ Object* Eval(Object* obj, Object* scope) {
     if (!obj) {
         throw RuntimeError("Can't evaluate empty list");
     }
-    if (Is<Number>(obj)) {
-        return obj;
-    }
-    if (Is<Bool>(obj)) {
-        return obj;
-    }
-    if (Is<Dot>(obj)) {
-        throw RuntimeError("Can't evaluate dot");
-    }
-    if (Is<Symbol>(obj)) {
-        return As<Scope>(scope)->GetObject(As<Symbol>(obj)->GetName());
+    switch (GetObjectType(obj)) {
+        case ObjectType::kNumber:
+        case ObjectType::kBool:
+            return obj;
+        case ObjectType::kDot:
+            throw RuntimeError("Can't evaluate dot");
+        case ObjectType::kFrameLayout:
+            // a lambda expression evaluated as a call after `lambda` was rebound
+            return Eval(static_cast<FrameLayout*>(obj)->GetParams(), scope);
+        case ObjectType::kLocalSymbol: {
+            auto local = static_cast<LocalSymbol*>(obj);
+            return static_cast<Scope*>(scope)->GetLocal(local->GetDepth(), local->GetSlot(),
+                                                         local->GetId());
+        }
+        case ObjectType::kGlobalSymbol:
+            return static_cast<Scope*>(scope)->GetGlobal(static_cast<GlobalSymbol*>(obj));
+        case ObjectType::kSymbol:
+        case ObjectType::kLambda:
+        case ObjectType::kReserved:
+            return static_cast<Scope*>(scope)->GetObject(static_cast<Symbol*>(obj)->GetId());
+        default:
+            ASSERT(Is<Cell>(obj), "Unknown Object");
     }
-    ASSERT(Is<Cell>(obj), "Unknown Object");
-    
-    auto cell = As<Cell>(obj);
+
+    StackLimit::Check();
+    auto cell = static_cast<Cell*>(obj);
     auto func = Eval(cell->GetFirst(), scope);
+    Root func_root(func);
     if (!Is<Function>(func)) {
         throw RuntimeError("Unknown function");
     }
-    return As<Function>(func)->Call(cell->GetSecond(), scope);
+    return static_cast<Function*>(func)->Call(cell->GetSecond(), scope);
 }
 
 std::string Print(Object* obj) {
@@ -124,13 +158,32 @@ std::string Print(Object* obj) {
     return GetString(tokens);
 }
 
-Interpreter::Interpreter() : global_scope_(Heap::GetHeap().Make<Scope>()) {
+Object* FindBuiltin(uint32_t name) {
+    static const std::unordered_map<uint32_t, Object*> builtins = [] {
+        std::unordered_map<uint32_t, Object*> builtins;
+        for (const auto& [name, func] : kAdvancedFunctions) {
+            builtins[SymbolTable::Get().GetId(name)] = func;
+        }
+        for (const auto& [name, func] : kBasicFunctions) {
+            builtins[SymbolTable::Get().GetId(name)] = func;
+        }
+        return builtins;
+    }();
+    auto it = builtins.find(name);
+    return it == builtins.end() ? nullptr : it->second;
+}
+
+Interpreter::Interpreter(Evaluator evaluator)
+    : global_scope_(Heap::GetHeap().Make<Scope>()),
+      evaluator_(evaluator),
+      stack_limit_(GetDefaultStackLimit()),
+      jit_threshold_(Jit::kDefaultThreshold) {
     Heap::GetHeap().SetGlobalScope(global_scope_);
     for (const auto& [name, func] : kAdvancedFunctions) {
-        As<Scope>(global_scope_)->AddObject(name, func);
+        As<Scope>(global_scope_)->AddObject(SymbolTable::Get().GetId(name), func);
     }
     for (const auto& [name, func] : kBasicFunctions) {
-        As<Scope>(global_scope_)->AddObject(name, func);
+        As<Scope>(global_scope_)->AddObject(SymbolTable::Get().GetId(name), func);
     }
     Heap::GetHeap().MarkAndSweep();
 }
@@ -139,17 +192,43 @@ Interpreter::~Interpreter() {
     Heap::GetHeap().SetGlobalScope(nullptr);
 }
 
+void Interpreter::SetEvaluator(Evaluator evaluator) {
+    evaluator_ = evaluator;
+}
+
+void Interpreter::SetStackLimit(size_t bytes) {
+    stack_limit_ = bytes;
+}
+
+void Interpreter::SetMaxDepth(size_t depth) {
+    vm_.SetMaxDepth(depth);
+}
+
+void Interpreter::SetJitThreshold(size_t calls) {
+    jit_threshold_ = calls;
+}
+
 std::string Interpreter::Run(const std::string& line) {
     std::stringstream stream{line};
     Tokenizer tokenizer(&stream);
     auto& heap = Heap::GetHeap();
     Object* root = Read(&tokenizer);
+    Root root_root(root);
     if (!tokenizer.IsEnd()) {
         throw SyntaxError("Expected end of line at the end of command. Found: " +
                           std::to_string(static_cast<char>(stream.peek())));
     }
-    auto res = Eval(root, global_scope_);
+    StackLimit stack_limit(stack_limit_);
+    JitThreshold jit_threshold(jit_threshold_);
+    Object* res;
+    if (evaluator_ == Evaluator::kBytecode) {
+        Object* code = Compiler::CompileExpression(root);
+        Root code_root(code);
+        res = vm_.Execute(code, global_scope_);
+    } else {
+        res = Eval(root, global_scope_);
+    }
     std::string ans = Print(res);
-    heap.MarkAndSweep();
+    heap.CollectAtSafePoint();
     return ans;
 }
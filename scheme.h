@@ -2,7 +2,9 @@
 
 #include "object.h"
 #include "scope.h"
+#include "vm.h"
 
+#include <cstdint>
 #include <string>
 #include <memory>
 
@@ -10,12 +12,31 @@ Object* Eval(Object* obj, Object* scope);
 
 std::string Print(Object* obj);
 
+// the permanent Reserved object of the builtin named by the symbol id, nullptr if there is none
+Object* FindBuiltin(uint32_t name);
+
+// kTree walks the expressions with Eval, kBytecode compiles them and runs them on the VM
+enum class Evaluator { kTree, kBytecode };
+
 class Interpreter {
 public:
-    Interpreter();
+    Interpreter(Evaluator evaluator = Evaluator::kTree);
     ~Interpreter();
     std::string Run(const std::string& line);
 
+    void SetEvaluator(Evaluator evaluator);
+    // evaluation raises a RuntimeError once it uses `bytes` of the native stack
+    void SetStackLimit(size_t bytes);
+    // calls on the bytecode VM nested deeper than `depth` frames raise a RuntimeError
+    void SetMaxDepth(size_t depth);
+    // lambdas are compiled to native code on their `calls`-th call while this interpreter runs,
+    // 0 turns the JIT off, see Jit
+    void SetJitThreshold(size_t calls);
+
 private:
     Object* global_scope_;
+    Evaluator evaluator_;
+    size_t stack_limit_;
+    size_t jit_threshold_;
+    VM vm_;
 };
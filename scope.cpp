@@ -1,55 +1,240 @@
 #include "scope.h"
 
 #include "error.h"
+#include "heap.h"
 #include "object.h"
 #include "scheme.h"
+#include "symbol_table.h"
 
-Scope::Scope() : prev_scope_(nullptr){};
+#include <new>
+#include <utility>
 
-Scope::Scope(Object* other) : prev_scope_(As<Scope>(other)){};
+FrameLayout::FrameLayout(Object* params, Object* body, std::vector<uint32_t> names,
+                         size_t arg_count)
+    : Object(ObjectType::kFrameLayout),
+      params_(params),
+      body_(body),
+      analyzed_body_(nullptr),
+      code_(nullptr),
+      jit_code_(nullptr),
+      names_(std::move(names)),
+      arg_count_(arg_count),
+      calls_(0),
+      immutable_(names_.size(), false),
+      epoch_(0),
+      flat_(false),
+      may_escape_(true),
+      capture_layout_(nullptr) {
+    Heap::GetHeap().WriteBarrier(this, params_);
+    Heap::GetHeap().WriteBarrier(this, body_);
+}
+
+void FrameLayout::SetAnalyzedBody(Object* body) {
+    analyzed_body_ = body;
+    Heap::GetHeap().WriteBarrier(this, analyzed_body_);
+}
+
+void FrameLayout::SetCode(Object* code) {
+    code_ = code;
+    Heap::GetHeap().WriteBarrier(this, code_);
+}
+
+void FrameLayout::SetJitCode(Object* code) {
+    jit_code_ = code;
+    Heap::GetHeap().WriteBarrier(this, jit_code_);
+}
+
+void FrameLayout::SetImmutable(std::vector<bool> immutable) {
+    immutable_ = std::move(immutable);
+}
+
+void FrameLayout::SetCallees(std::vector<uint32_t> callees) {
+    callees_ = std::move(callees);
+}
+
+void FrameLayout::SetCaptures(Object* capture_layout, std::vector<CapturedVariable> captures) {
+    flat_ = true;
+    capture_layout_ = capture_layout;
+    captures_ = std::move(captures);
+    Heap::GetHeap().WriteBarrier(this, capture_layout_);
+}
+
+uint32_t FrameLayout::FindSlot(uint32_t name) const {
+    for (size_t slot = names_.size(); slot > 0; --slot) {
+        if (names_[slot - 1] == name) {
+            return slot - 1;
+        }
+    }
+    return kNoSlot;
+}
+
+void FrameLayout::Trace(Tracer& tracer) {
+    tracer.Visit(params_);
+    tracer.Visit(body_);
+    tracer.Visit(analyzed_body_);
+    tracer.Visit(code_);
+    tracer.Visit(jit_code_);
+    tracer.Visit(capture_layout_);
+}
+
+Object* FrameLayout::MoveTo(void* slot) {
+    return new (slot) FrameLayout(std::move(*this));
+}
+
+Scope::Scope()
+    : Object(ObjectType::kScope), captured_(false), prev_scope_(nullptr), layout_(nullptr){};
+
+Scope::Scope(Object* other)
+    : Object(ObjectType::kScope),
+      captured_(false),
+      prev_scope_(As<Scope>(other)),
+      layout_(nullptr) {
+    Heap::GetHeap().WriteBarrier(this, prev_scope_);
+}
+
+Scope::Scope(Object* other, Object* layout)
+    : Object(ObjectType::kScope),
+      captured_(false),
+      prev_scope_(As<Scope>(other)),
+      layout_(layout),
+      slots_(As<FrameLayout>(layout)->GetSlotCount(), Unbound()) {
+    Heap::GetHeap().WriteBarrier(this, prev_scope_);
+    Heap::GetHeap().WriteBarrier(this, layout_);
+}
+
+Scope::~Scope() {
+    if (layout_ && objects_) {
+        --dynamic_frames_;
+    }
+}
 
-Object* Scope::GetObject(const std::string& name) {
-    auto it = objects_.find(name);
-    if (it == objects_.end()) {
-        if (prev_scope_ == nullptr) {
-            throw NameError("Can't find object \'" + name + "\'");
+Object* Scope::GetObject(uint32_t name) {
+    if (uint32_t slot = FindBoundSlot(name); slot != FrameLayout::kNoSlot) {
+        return slots_[slot];
+    }
+    if (objects_) {
+        if (auto it = objects_->find(name); it != objects_->end()) {
+            return it->second;
         }
-        return prev_scope_->GetObject(name);
     }
-    return it->second;
+    if (prev_scope_ == nullptr) {
+        throw NameError("Can't find object \'" + SymbolTable::Get().GetName(name) + "\'");
+    }
+    return static_cast<Scope*>(prev_scope_)->GetObject(name);
 }
 
-void Scope::SetObject(const std::string& name, Object* object) {
-    auto it = objects_.find(name);
-    if (it == objects_.end()) {
-        if (prev_scope_ == nullptr) {
-            throw NameError("Can't find object \'" + name + "\'");
+Object* Scope::LookupGlobal(GlobalSymbol* symbol) {
+    if (dynamic_frames_) {
+        return GetObject(symbol->GetId());
+    }
+    Scope* scope = this;
+    while (scope->prev_scope_) {
+        scope = static_cast<Scope*>(scope->prev_scope_);
+    }
+    if (scope->objects_) {
+        if (auto it = scope->objects_->find(symbol->GetId()); it != scope->objects_->end()) {
+            symbol->SetCell(&it->second);
+            return it->second;
         }
-        prev_scope_->SetObject(name, object);
+    }
+    throw NameError("Can't find object \'" + symbol->GetName() + "\'");
+}
+
+void Scope::SetObject(uint32_t name, Object* object) {
+    if (uint32_t slot = FindBoundSlot(name); slot != FrameLayout::kNoSlot) {
+        SetSlot(slot, object);
         return;
     }
-    objects_[name] = object;
+    if (objects_) {
+        if (auto it = objects_->find(name); it != objects_->end()) {
+            if (Is<Reserved>(it->second) || IsAlias(name, object)) {
+                ++builtin_epoch_;
+            }
+            it->second = object;
+            Heap::GetHeap().WriteBarrier(this, object);
+            return;
+        }
+    }
+    if (prev_scope_ == nullptr) {
+        throw NameError("Can't find object \'" + SymbolTable::Get().GetName(name) + "\'");
+    }
+    static_cast<Scope*>(prev_scope_)->SetObject(name, object);
 }
 
-void Scope::AddObject(const std::string& name, Object* object) {
-    objects_[name] = object;
+void Scope::AddObject(uint32_t name, Object* object) {
+    if (layout_) {
+        if (uint32_t slot = As<FrameLayout>(layout_)->FindSlot(name);
+            slot != FrameLayout::kNoSlot) {
+            SetSlot(slot, object);
+            return;
+        }
+    }
+    if (!objects_) {
+        objects_ = std::make_unique<std::unordered_map<uint32_t, Object*>>();
+        if (layout_) {
+            ++dynamic_frames_;
+        }
+    }
+    Object*& entry = (*objects_)[name];
+    if (!IsGlobal() || Is<Reserved>(entry) || IsAlias(name, object)) {
+        ++builtin_epoch_;
+    }
+    entry = object;
+    Heap::GetHeap().WriteBarrier(this, object);
+}
+
+void Scope::SetSlot(uint32_t slot, Object* object) {
+    slots_[slot] = object;
+    Heap::GetHeap().WriteBarrier(this, object);
+}
+
+uint32_t Scope::FindBoundSlot(uint32_t name) const {
+    if (!layout_) {
+        return FrameLayout::kNoSlot;
+    }
+    uint32_t slot = As<FrameLayout>(layout_)->FindSlot(name);
+    if (slot != FrameLayout::kNoSlot && slots_[slot] == Unbound()) {
+        return FrameLayout::kNoSlot;
+    }
+    return slot;
+}
+
+void Scope::Reuse(Object* other, Object* layout) {
+    prev_scope_ = As<Scope>(other);
+    layout_ = layout;
+    // keeps the capacity of the slots
+    slots_.assign(As<FrameLayout>(layout)->GetSlotCount(), Unbound());
+    Heap::GetHeap().WriteBarrier(this, prev_scope_);
+    Heap::GetHeap().WriteBarrier(this, layout_);
+}
+
+bool Scope::IsAlias(uint32_t name, Object* object) {
+    return Is<Reserved>(object) && As<Reserved>(object)->GetId() != name;
 }
 
 bool Scope::IsGlobal() const {
     return prev_scope_ == nullptr;
 }
 
-void Scope::Mark() {
-    if (marked_) {
-        return;
+void Scope::Trace(Tracer& tracer) {
+    tracer.Visit(prev_scope_);
+    tracer.Visit(layout_);
+    for (auto& obj : slots_) {
+        tracer.Visit(obj);
     }
-    marked_ = true;
-    if (prev_scope_) {
-        prev_scope_->Mark();
-    }
-    for (const auto& obj : objects_) {
-        if (obj.second) {
-            obj.second->Mark();
+    if (objects_) {
+        for (auto& obj : *objects_) {
+            tracer.Visit(obj.second);
         }
     }
 }
+
+Object* Scope::MoveTo(void* slot) {
+    auto scope = new (slot) Scope();
+    scope->prev_scope_ = prev_scope_;
+    scope->layout_ = layout_;
+    scope->slots_ = std::move(slots_);
+    scope->objects_ = std::move(objects_);
+    scope->captured_ = captured_;
+    return scope;
+}
@@ -4,31 +4,242 @@
 
 #include "object.h"
 
-#include <map>
+#include <cstddef>
+#include <cstdint>
 #include <memory>
-#include <string>
+#include <unordered_map>
+#include <vector>
 
+// a variable of an enclosing frame copied into the frame of a flat closure
+struct CapturedVariable {
+    uint32_t depth;
+    uint32_t slot;
+    uint32_t name;
+};
+
+// Names of the slots of the frames created by calls of one lambda: the arguments followed by the
+// variables defined in the body. A name may repeat, the last slot with the name wins.
+// Also holds the argument list it replaces in the lambda expression, the body, the analyzed body,
+// the bytecode of the body once the VM compiled it and the native code once the JIT compiled it.
+// Closures of a flat lambda keep a frame of the capture layout with copies of the variables of
+// the enclosing frames they refer to instead of the scope they are created in, see Capture.
+class FrameLayout : public Object {
+public:
+    static constexpr ObjectType kFirstType = ObjectType::kFrameLayout;
+    static constexpr ObjectType kLastType = ObjectType::kFrameLayout;
+    static constexpr uint32_t kNoSlot = UINT32_MAX;
+
+    FrameLayout(Object* params, Object* body, std::vector<uint32_t> names, size_t arg_count);
+    ~FrameLayout() = default;
+
+    Object* GetParams() const {
+        return params_;
+    }
+    Object* GetBody() const {
+        return body_;
+    }
+    Object* GetAnalyzedBody() const {
+        return analyzed_body_;
+    }
+    void SetAnalyzedBody(Object* body);
+    Object* GetCode() const {
+        return code_;
+    }
+    void SetCode(Object* code);
+    Object* GetJitCode() const {
+        return jit_code_;
+    }
+    void SetJitCode(Object* code);
+    // counts calls of the lambda for the JIT, returns the count
+    size_t CountCall() {
+        return ++calls_;
+    }
+    void ResetCalls() {
+        calls_ = 0;
+    }
+    size_t GetArgCount() const {
+        return arg_count_;
+    }
+    size_t GetSlotCount() const {
+        return names_.size();
+    }
+    // kNoSlot if the frame has no slot with the name
+    uint32_t FindSlot(uint32_t name) const;
+    uint32_t GetName(uint32_t slot) const {
+        return names_[slot];
+    }
+
+    // whether the variable of the slot keeps the value it is bound to on the call, so closures
+    // may copy it
+    bool IsImmutable(uint32_t slot) const {
+        return immutable_[slot];
+    }
+    void SetImmutable(std::vector<bool> immutable);
+    // global names the body calls. The arguments are immutable only while none of them refers to
+    // set! or define under another name, see Capture
+    const std::vector<uint32_t>& GetCallees() const {
+        return callees_;
+    }
+    void SetCallees(std::vector<uint32_t> callees);
+    // Scope::GetBuiltinEpoch() when the callees were last checked
+    size_t GetEpoch() const {
+        return epoch_;
+    }
+    void SetEpoch(size_t epoch) {
+        epoch_ = epoch;
+    }
+
+    bool IsFlat() const {
+        return flat_;
+    }
+    // nullptr if the lambda captures nothing
+    Object* GetCaptureLayout() const {
+        return capture_layout_;
+    }
+    // where the captured variables are, relative to the scope a closure is created in
+    const std::vector<CapturedVariable>& GetCaptures() const {
+        return captures_;
+    }
+    void SetCaptures(Object* capture_layout, std::vector<CapturedVariable> captures);
+
+    // whether the body may create closures, which may keep the frame of the call alive after it
+    // returns. Frames of other lambdas go back to the frame pool of the heap
+    bool MayEscape() const {
+        return may_escape_;
+    }
+    void SetMayEscape(bool may_escape) {
+        may_escape_ = may_escape;
+    }
+
+protected:
+    virtual void Trace(Tracer& tracer) override;
+    virtual Object* MoveTo(void* slot) override;
+
+private:
+    Object* params_;
+    Object* body_;
+    Object* analyzed_body_;
+    Object* code_;
+    Object* jit_code_;
+    std::vector<uint32_t> names_;
+    size_t arg_count_;
+    size_t calls_;
+    std::vector<bool> immutable_;
+    std::vector<uint32_t> callees_;
+    size_t epoch_;
+    bool flat_;
+    bool may_escape_;
+    Object* capture_layout_;
+    std::vector<CapturedVariable> captures_;
+};
+
+// The global scope is a hash table of cells holding values. Scopes of lambda calls are frames:
+// a flat array of slots described by the FrameLayout of the lambda, plus a table for names
+// defined in ways Resolve could not see.
 class Scope : public Object {
     friend class Heap;
 
 public:
+    static constexpr ObjectType kFirstType = ObjectType::kScope;
+    static constexpr ObjectType kLastType = ObjectType::kScope;
+
     Scope();
     Scope(Object* other);
+    // frame with unbound slots
+    Scope(Object* other, Object* layout);
     Scope(Scope& other) = delete;
     Scope(Scope&& other) = delete;
     Scope& operator=(const Scope& other) = delete;
     Scope& operator=(Scope&& other) = delete;
 
-    virtual ~Scope() = default;
+    virtual ~Scope();
+
+    // names are SymbolTable ids
+    Object* GetObject(uint32_t name);
+    void SetObject(uint32_t name, Object* object);
+    void AddObject(uint32_t name, Object* object);
+
+    Object* GetLayout() const {
+        return layout_;
+    }
+    Object* GetPrevScope() const {
+        return prev_scope_;
+    }
+
+    // value of a LocalSymbol, `name` is used if the slot is not bound yet
+    Object* GetLocal(uint32_t depth, uint32_t slot, uint32_t name) {
+        Scope* scope = this;
+        for (; depth; --depth) {
+            // a name defined behind the back of Resolve may shadow the slot
+            if (scope->objects_) {
+                return GetObject(name);
+            }
+            scope = static_cast<Scope*>(scope->prev_scope_);
+        }
+        Object* value = scope->slots_[slot];
+        if (value == Unbound()) {
+            return static_cast<Scope*>(scope->prev_scope_)->GetObject(name);
+        }
+        return value;
+    }
 
-    Object* GetObject(const std::string& name);
-    void SetObject(const std::string& name, Object* object);
-    void AddObject(const std::string& name, Object* object);
+    // value of a GlobalSymbol, the symbol caches the cell of the variable
+    Object* GetGlobal(GlobalSymbol* symbol) {
+        if (symbol->GetCell() && !dynamic_frames_) {
+            return *symbol->GetCell();
+        }
+        return LookupGlobal(symbol);
+    }
+
+    // a closure refers to the scope, so the frame is not reused once its call returns
+    void MarkCaptured() {
+        captured_ = true;
+    }
+
+    void SetSlot(uint32_t slot, Object* object);
+    // the slots of a frame, the arguments take the first ones
+    Object* const* GetSlots() const {
+        return slots_.data();
+    }
+
+    // changes whenever a name may stop referring to the builtin it refers to: a variable holding
+    // a builtin is redefined or set, or a name is defined in a frame outside of its slots. Also
+    // changes when a global variable starts referring to a builtin of another name
+    static size_t GetBuiltinEpoch() {
+        return builtin_epoch_;
+    }
+    static bool HasDynamicFrames() {
+        return dynamic_frames_;
+    }
 
 protected:
-    Scope* prev_scope_;
-    std::map<std::string, Object*> objects_;
+    // value of slots whose variables are not defined yet: an immediate with the boolean tag
+    // and a value no boolean has
+    static Object* Unbound() {
+        return reinterpret_cast<Object*>((uintptr_t(2) << 2) | kBoolTag);
+    }
+
+    // number of frames holding names outside of their slots, such a name may shadow a global
+    // variable, so cached cells are not used while there are any
+    static inline size_t dynamic_frames_ = 0;
+    static inline size_t builtin_epoch_ = 0;
+
+    // declared first to take the padding after the object header
+    bool captured_;
+    Object* prev_scope_;
+    Object* layout_;
+    std::vector<Object*> slots_;
+    // created on the first name stored outside of the slots
+    std::unique_ptr<std::unordered_map<uint32_t, Object*>> objects_;
 
+    // slot bound to the name, kNoSlot if there is none
+    uint32_t FindBoundSlot(uint32_t name) const;
+    // turns a released frame into a frame with unbound slots, see Heap::MakeFrame
+    void Reuse(Object* other, Object* layout);
+    Object* LookupGlobal(GlobalSymbol* symbol);
+    // whether `object` is a builtin with another name than `name`
+    static bool IsAlias(uint32_t name, Object* object);
     bool IsGlobal() const;
-    virtual void Mark() override;
+    virtual void Trace(Tracer& tracer) override;
+    virtual Object* MoveTo(void* slot) override;
 };
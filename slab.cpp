@@ -0,0 +1,308 @@
+#include "slab.h"
+
+#include "assertions.h"
+
+#include <sys/mman.h>
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstdio>
+#include <iterator>
+#include <new>
+#include <utility>
+
+namespace {
+
+size_t RoundUp(size_t size, size_t alignment) {
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+}  // namespace
+
+Slab* Slab::Create(size_t object_size) {
+    // map twice the size and cut off the misaligned ends
+    void* raw = mmap(nullptr, 2 * kSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) {
+        throw std::bad_alloc();
+    }
+    auto begin = reinterpret_cast<uintptr_t>(raw);
+    auto aligned = RoundUp(begin, kSize);
+    if (aligned != begin) {
+        munmap(raw, aligned - begin);
+    }
+    if (aligned + kSize != begin + 2 * kSize) {
+        munmap(reinterpret_cast<void*>(aligned + kSize), begin + kSize - aligned);
+    }
+    return new (reinterpret_cast<void*>(aligned)) Slab(object_size);
+}
+
+void Slab::Release(Slab* slab) {
+    slab->~Slab();
+    munmap(slab, kSize);
+}
+
+Slab* Slab::Of(const void* ptr) {
+    return reinterpret_cast<Slab*>(reinterpret_cast<uintptr_t>(ptr) & ~(kSize - 1));
+}
+
+Slab::Slab(size_t object_size)
+    : object_size_(object_size),
+      allocated_(0),
+      cursor_(0),
+      partial_(false),
+      swept_(true),
+      slots_(),
+      used_(),
+      marks_(),
+      remembered_(),
+      forwarded_() {
+    size_t begin = RoundUp(sizeof(Slab), kAlignment) / kAlignment;
+    size_t step = object_size_ / kAlignment;
+    capacity_ = (kGranules - begin) / step;
+    for (size_t id = 0; id < capacity_; ++id) {
+        size_t granule = begin + id * step;
+        slots_[granule / 64] |= uint64_t(1) << (granule % 64);
+    }
+}
+
+void* Slab::Allocate() {
+    ASSERT(!IsFull(), "Allocation from a full slab");
+    while (!(slots_[cursor_] & ~used_[cursor_])) {
+        ++cursor_;
+    }
+    uint64_t free = slots_[cursor_] & ~used_[cursor_];
+    size_t id = std::countr_zero(free);
+    used_[cursor_] |= uint64_t(1) << id;
+    ++allocated_;
+    return GetGranulePtr(cursor_ * 64 + id);
+}
+
+void Slab::Free(void* ptr) {
+    size_t id = GetGranule(ptr);
+    uint64_t bit = uint64_t(1) << (id % 64);
+    ASSERT(used_[id / 64] & bit, "Double free of a slab slot");
+    used_[id / 64] &= ~bit;
+    marks_[id / 64] &= ~bit;
+    remembered_[id / 64] &= ~bit;
+    forwarded_[id / 64] &= ~bit;
+    cursor_ = std::min(cursor_, id / 64);
+    --allocated_;
+}
+
+void Slab::ClearMarks() {
+    std::fill(std::begin(marks_), std::end(marks_), 0);
+}
+
+size_t Slab::GetMarkedCount() const {
+    size_t count = 0;
+    for (size_t word = 0; word < kWords; ++word) {
+        count += std::popcount(used_[word] & marks_[word]);
+    }
+    return count;
+}
+
+bool Slab::Remember(const void* ptr) {
+    size_t id = GetGranule(ptr);
+    uint64_t bit = uint64_t(1) << (id % 64);
+    if (remembered_[id / 64] & bit) {
+        return false;
+    }
+    remembered_[id / 64] |= bit;
+    return true;
+}
+
+void Slab::Forget(const void* ptr) {
+    size_t id = GetGranule(ptr);
+    remembered_[id / 64] &= ~(uint64_t(1) << (id % 64));
+}
+
+void Slab::SetForward(void* ptr, void* copy) {
+    size_t id = GetGranule(ptr);
+    *static_cast<void**>(ptr) = copy;
+    forwarded_[id / 64] |= uint64_t(1) << (id % 64);
+}
+
+void* Slab::GetForward(const void* ptr) const {
+    size_t id = GetGranule(ptr);
+    if (!(forwarded_[id / 64] & (uint64_t(1) << (id % 64)))) {
+        return nullptr;
+    }
+    return *static_cast<void* const*>(ptr);
+}
+
+bool Slab::HasHoles() const {
+    size_t word = 0;
+    while (word < kWords && !(slots_[word] & ~used_[word])) {
+        ++word;
+    }
+    if (word == kWords) {
+        return false;
+    }
+    uint64_t free = slots_[word] & ~used_[word];
+    // allocated slots after the first free one
+    if (used_[word] >> std::countr_zero(free)) {
+        return true;
+    }
+    for (++word; word < kWords; ++word) {
+        if (used_[word]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Slab::IsFull() const {
+    return allocated_ == capacity_;
+}
+
+bool Slab::IsEmpty() const {
+    return allocated_ == 0;
+}
+
+size_t Slab::GetObjectSize() const {
+    return object_size_;
+}
+
+size_t Slab::GetCapacity() const {
+    return capacity_;
+}
+
+size_t Slab::GetAllocated() const {
+    return allocated_;
+}
+
+SlabAllocator::SlabAllocator() : classes_(kMaxObjectSize / Slab::kAlignment), destroy_(nullptr) {
+}
+
+SlabAllocator::~SlabAllocator() {
+    for (const auto& size_class : classes_) {
+        for (const auto& slab : size_class.slabs) {
+            Slab::Release(slab);
+        }
+    }
+}
+
+void* SlabAllocator::Allocate(size_t size) {
+    ASSERT(size <= kMaxObjectSize, "Object is too big for the slab allocator");
+    auto& size_class = classes_[(size - 1) / Slab::kAlignment];
+    if (size_class.partial.empty()) {
+        SweepLazily(size_class);
+    }
+    if (size_class.partial.empty()) {
+        Slab* slab = Slab::Create(RoundUp(size, Slab::kAlignment));
+        slab->partial_ = true;
+        size_class.slabs.push_back(slab);
+        size_class.partial.push_back(slab);
+    }
+    Slab* slab = size_class.partial.back();
+    void* slot = slab->Allocate();
+    if (slab->IsFull()) {
+        slab->partial_ = false;
+        size_class.partial.pop_back();
+    }
+    return slot;
+}
+
+void SlabAllocator::Free(void* ptr) {
+    Slab* slab = Slab::Of(ptr);
+    slab->Free(ptr);
+    if (!slab->partial_) {
+        slab->partial_ = true;
+        classes_[(slab->GetObjectSize() - 1) / Slab::kAlignment].partial.push_back(slab);
+    }
+}
+
+void SlabAllocator::ClearMarks() {
+    for (const auto& size_class : classes_) {
+        for (const auto& slab : size_class.slabs) {
+            slab->ClearMarks();
+        }
+    }
+}
+
+void SlabAllocator::StartLazySweep(Destroy destroy) {
+    destroy_ = destroy;
+    for (auto& size_class : classes_) {
+        for (const auto& slab : size_class.slabs) {
+            slab->swept_ = false;
+            slab->partial_ = false;
+        }
+        size_class.partial.clear();
+        size_class.unswept = size_class.slabs;
+    }
+}
+
+void SlabAllocator::SweepLazily(SizeClass& size_class) {
+    while (!size_class.unswept.empty() && size_class.partial.empty()) {
+        Slab* slab = size_class.unswept.back();
+        size_class.unswept.pop_back();
+        slab->Sweep(destroy_);
+        slab->swept_ = true;
+        if (!slab->IsFull()) {
+            slab->partial_ = true;
+            size_class.partial.push_back(slab);
+        }
+    }
+}
+
+void SlabAllocator::FinishLazySweep() {
+    bool swept = false;
+    for (auto& size_class : classes_) {
+        for (const auto& slab : size_class.unswept) {
+            slab->Sweep(destroy_);
+            slab->swept_ = true;
+            swept = true;
+        }
+        size_class.unswept.clear();
+    }
+    if (swept) {
+        ReleaseEmpty();
+    }
+}
+
+size_t SlabAllocator::GetMarkedCount() const {
+    size_t count = 0;
+    for (const auto& size_class : classes_) {
+        for (const auto& slab : size_class.slabs) {
+            count += slab->GetMarkedCount();
+        }
+    }
+    return count;
+}
+
+void SlabAllocator::OpenFreshSlabs() {
+    for (auto& size_class : classes_) {
+        std::erase_if(size_class.partial, [](Slab* slab) { return slab->HasHoles(); });
+    }
+}
+
+void SlabAllocator::ReleaseEmpty() {
+    for (auto& size_class : classes_) {
+        std::vector<Slab*> alive;
+        size_class.partial.clear();
+        for (const auto& slab : size_class.slabs) {
+            if (!slab->swept_) {
+                alive.push_back(slab);
+                continue;
+            }
+            if (slab->IsEmpty()) {
+                Slab::Release(slab);
+                continue;
+            }
+            alive.push_back(slab);
+            slab->partial_ = !slab->IsFull();
+            if (slab->partial_) {
+                size_class.partial.push_back(slab);
+            }
+        }
+        size_class.slabs = std::move(alive);
+    }
+}
+
+size_t SlabAllocator::GetSlabCount() const {
+    size_t count = 0;
+    for (const auto& size_class : classes_) {
+        count += size_class.slabs.size();
+    }
+    return count;
+}
@@ -0,0 +1,208 @@
+#pragma once
+
+#include "parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Fixed size chunk of memory holding objects of a single size class. Slabs are aligned to their
+// size, so the slab owning an object is found by masking the object address. Allocation, mark and
+// remembered state live in side bitmaps with one bit per 16-byte granule, so the collector never
+// writes into objects and sweeping works on whole bitmap words.
+class Slab {
+    friend class SlabAllocator;
+
+public:
+    static constexpr size_t kSize = 1 << 16;
+    static constexpr size_t kAlignment = 16;
+    static constexpr size_t kGranules = kSize / kAlignment;
+    static constexpr size_t kWords = kGranules / 64;
+
+    static Slab* Create(size_t object_size);
+    static void Release(Slab* slab);
+    static Slab* Of(const void* ptr);
+
+    Slab(const Slab& other) = delete;
+    Slab& operator=(const Slab& other) = delete;
+
+    void* Allocate();
+    void Free(void* ptr);
+
+    // true if some free slot precedes an allocated one
+    bool HasHoles() const;
+    bool IsFull() const;
+    bool IsEmpty() const;
+    size_t GetObjectSize() const;
+    size_t GetCapacity() const;
+    size_t GetAllocated() const;
+
+    // sets the mark bit, returns false if it was already set
+    bool Mark(const void* ptr) {
+        size_t id = GetGranule(ptr);
+        uint64_t bit = uint64_t(1) << (id % 64);
+        if (marks_[id / 64] & bit) {
+            return false;
+        }
+        marks_[id / 64] |= bit;
+        return true;
+    }
+    // same as Mark, but may race with other threads marking the slab
+    bool MarkAtomic(const void* ptr) {
+        size_t id = GetGranule(ptr);
+        uint64_t bit = uint64_t(1) << (id % 64);
+        std::atomic_ref<uint64_t> word(marks_[id / 64]);
+        if (word.load(std::memory_order_relaxed) & bit) {
+            return false;
+        }
+        return !(word.fetch_or(bit, std::memory_order_relaxed) & bit);
+    }
+    bool IsMarked(const void* ptr) const {
+        size_t id = GetGranule(ptr);
+        return marks_[id / 64] & (uint64_t(1) << (id % 64));
+    }
+    void ClearMarks();
+    size_t GetMarkedCount() const;
+
+    bool Remember(const void* ptr);
+    void Forget(const void* ptr);
+
+    // overwrites a moved out object with the address of its copy
+    void SetForward(void* ptr, void* copy);
+    // address of the copy, nullptr if the object was not moved
+    void* GetForward(const void* ptr) const;
+
+    // calls `destroy` for every allocated object without a mark bit and frees its slot
+    template <class F>
+    void Sweep(F destroy) {
+        for (size_t word = 0; word < kWords; ++word) {
+            uint64_t dead = used_[word] & ~marks_[word];
+            if (!dead) {
+                continue;
+            }
+            allocated_ -= std::popcount(dead);
+            used_[word] &= marks_[word];
+            for (; dead; dead &= dead - 1) {
+                destroy(GetGranulePtr(word * 64 + std::countr_zero(dead)));
+            }
+        }
+        cursor_ = 0;
+    }
+
+    template <class F>
+    void ForEach(F func) {
+        for (size_t word = 0; word < kWords; ++word) {
+            for (uint64_t used = used_[word]; used; used &= used - 1) {
+                func(GetGranulePtr(word * 64 + std::countr_zero(used)));
+            }
+        }
+    }
+
+private:
+    Slab(size_t object_size);
+
+    size_t GetGranule(const void* ptr) const {
+        return (reinterpret_cast<uintptr_t>(ptr) & (kSize - 1)) / kAlignment;
+    }
+    void* GetGranulePtr(size_t id) {
+        return reinterpret_cast<char*>(this) + id * kAlignment;
+    }
+
+    size_t object_size_;
+    size_t capacity_;
+    size_t allocated_;
+    // first bitmap word that may have a free slot
+    size_t cursor_;
+    // set while the slab is in the partial list of its size class
+    bool partial_;
+    // cleared when a lazy sweep starts, until the slab is swept
+    bool swept_;
+    // granules where slots start
+    uint64_t slots_[kWords];
+    uint64_t used_[kWords];
+    uint64_t marks_[kWords];
+    uint64_t remembered_[kWords];
+    uint64_t forwarded_[kWords];
+};
+
+// Per size class collection of slabs. Empty slabs are unmapped after every full sweep.
+// A lazy sweep only remembers which slabs are to be swept, each of them is swept when its size
+// class runs out of free slots or when the sweep is finished.
+class SlabAllocator {
+public:
+    static constexpr size_t kMaxObjectSize = 256;
+
+    using Destroy = void (*)(void* slot);
+
+    SlabAllocator();
+    SlabAllocator(const SlabAllocator& other) = delete;
+    SlabAllocator& operator=(const SlabAllocator& other) = delete;
+    ~SlabAllocator();
+
+    void* Allocate(size_t size);
+    void Free(void* ptr);
+
+    void ClearMarks();
+
+    // objects without a mark bit are destroyed with `destroy` when their slab is swept, until
+    // then the mark bits must not change
+    void StartLazySweep(Destroy destroy);
+    void FinishLazySweep();
+
+    // number of allocated objects with a mark bit
+    size_t GetMarkedCount() const;
+
+    // following allocations fill only slabs without holes, until ReleaseEmpty
+    void OpenFreshSlabs();
+    // unmaps empty slabs and rebuilds the partial lists
+    void ReleaseEmpty();
+
+    // slabs are split between `threads` threads, `destroy` must be safe to call concurrently
+    template <class F>
+    void Sweep(F destroy, size_t threads = 1) {
+        std::vector<Slab*> slabs;
+        for (const auto& size_class : classes_) {
+            slabs.insert(slabs.end(), size_class.slabs.begin(), size_class.slabs.end());
+        }
+        std::atomic<size_t> next = 0;
+        RunParallel(threads, [&](size_t) {
+            for (size_t begin; (begin = next.fetch_add(kSweepChunk)) < slabs.size();) {
+                size_t end = std::min(begin + kSweepChunk, slabs.size());
+                for (size_t id = begin; id < end; ++id) {
+                    slabs[id]->Sweep(destroy);
+                }
+            }
+        });
+        ReleaseEmpty();
+    }
+
+    template <class F>
+    void ForEach(F func) {
+        for (const auto& size_class : classes_) {
+            for (const auto& slab : size_class.slabs) {
+                slab->ForEach(func);
+            }
+        }
+    }
+
+    size_t GetSlabCount() const;
+
+private:
+    // slabs taken by a sweeping thread at once
+    static constexpr size_t kSweepChunk = 8;
+
+    struct SizeClass {
+        std::vector<Slab*> slabs;
+        std::vector<Slab*> partial;
+        std::vector<Slab*> unswept;
+    };
+
+    // sweeps slabs of the class until one of them has a free slot
+    void SweepLazily(SizeClass& size_class);
+
+    std::vector<SizeClass> classes_;
+    Destroy destroy_;
+};
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "constants.h"
+#include "error.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// Budget of native stack for nested evaluation. Eval, builtins and analyzed bodies recurse on the
+// C++ stack, so they check the budget and raise a RuntimeError once it is spent instead of
+// overflowing the stack. The budget is counted from the outermost StackLimit alive.
+class StackLimit {
+public:
+    explicit StackLimit(size_t bytes) : previous_(limit_) {
+        if (!limit_) {
+            auto base = reinterpret_cast<uintptr_t>(__builtin_frame_address(0));
+            limit_ = base > bytes ? base - bytes : 1;
+        }
+    }
+    StackLimit(const StackLimit& other) = delete;
+    StackLimit& operator=(const StackLimit& other) = delete;
+    ~StackLimit() {
+        limit_ = previous_;
+    }
+
+    // the stack grows down
+    static void Check() {
+        if (reinterpret_cast<uintptr_t>(__builtin_frame_address(0)) < limit_) {
+            throw RuntimeError(kTooDeep);
+        }
+    }
+
+    // the lowest address of the stack evaluation may use, 0 if there is no limit
+    static uintptr_t GetLimit() {
+        return limit_;
+    }
+
+private:
+    static inline uintptr_t limit_ = 0;
+    uintptr_t previous_;
+};
@@ -0,0 +1,30 @@
+#include "symbol_table.h"
+
+#include "heap.h"
+#include "object.h"
+
+SymbolTable& SymbolTable::Get() {
+    static SymbolTable table;
+    return table;
+}
+
+uint32_t SymbolTable::GetId(const std::string& name) {
+    auto [it, inserted] = ids_.try_emplace(name, names_.size());
+    if (inserted) {
+        names_.push_back(name);
+        symbols_.push_back(nullptr);
+    }
+    return it->second;
+}
+
+const std::string& SymbolTable::GetName(uint32_t id) const {
+    return names_[id];
+}
+
+Object* SymbolTable::Intern(const std::string& name) {
+    uint32_t id = GetId(name);
+    if (!symbols_[id]) {
+        symbols_[id] = Heap::GetHeap().MakePermanent<Symbol>(name);
+    }
+    return symbols_[id];
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "object_fwd.h"
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Maps every distinct name to a stable integer id and to one canonical Symbol, so symbols are
+// compared and looked up by id instead of by string. Canonical symbols live as long as the heap.
+class SymbolTable {
+public:
+    static SymbolTable& Get();
+    SymbolTable(const SymbolTable& other) = delete;
+    SymbolTable& operator=(const SymbolTable& other) = delete;
+
+    // id of the name, assigned on first use
+    uint32_t GetId(const std::string& name);
+    const std::string& GetName(uint32_t id) const;
+
+    // canonical symbol with the name, created on first use
+    Object* Intern(const std::string& name);
+
+private:
+    SymbolTable() = default;
+
+    std::unordered_map<std::string, uint32_t> ids_;
+    // deque keeps references returned by GetName valid
+    std::deque<std::string> names_;
+    std::vector<Object*> symbols_;
+};
@@ -0,0 +1,39 @@
+; arithmetic, lists and errors every evaluator reports the same way
+(+ 1 2 3) ; => 6
+(- 10) ; => -10
+(* 2 3 4) ; => 24
+(/ 20 3) ; => 6
+(/ 1 0)
+(+ 1 #t)
+(max 3 9 2) ; => 9
+(< 1 2 3) ; => #t
+(< 1 3 2) ; => #f
+(list 1 2 (list 3 4)) ; => (1 2 (3 4))
+(cons 1 2) ; => (1 . 2)
+(car '(1 2 3)) ; => 1
+(cdr '(1 2 3)) ; => (2 3)
+(car '())
+(list-ref '(1 2 3) 1) ; => 2
+(list-tail '(1 2 3) 1) ; => (2 3)
+(and 1 2 #f 3) ; => #f
+(or #f 2) ; => 2
+(if #f 1) ; => ()
+(quote (a b)) ; => (a b)
+undefined-name
+(1 2)
+()
+(define x 10)
+(set! x (+ x 1))
+x ; => 11
+(define l '(1 2 3))
+(set-car! l 5)
+l ; => (5 2 3)
+(define (square n) (* n n))
+(square 12) ; => 144
+(square)
+((lambda (a b) (- a b)) 7 2) ; => 5
+(lambda x)
+(define (fact n) (if (= n 0) 1 (* n (fact (- n 1)))))
+(fact 20) ; => 2432902008176640000
+(define (len l) (if (null? l) 0 (+ 1 (len (cdr l)))))
+(len '(1 2 3 4 5)) ; => 5
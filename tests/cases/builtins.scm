@@ -0,0 +1,36 @@
+; names of builtins may be rebound after bodies using them were folded, quickened or compiled
+(define (three) (+ 1 2))
+(define (add a b) (+ a b))
+(define (lt a b) (< a b))
+(define (warm n) (if (= n 0) (list (three) (add 20 22) (lt 1 2)) (warm (- n 1))))
+(warm 200) ; => (3 42 #t)
+(define plus +)
+(define + -)
+(three) ; => -1
+(add 20 22) ; => -2
+(warm 200) ; => (-1 -2 #t)
+(set! + plus)
+(three) ; => 3
+(add 20 22) ; => 42
+(define < >)
+(lt 1 2) ; => #f
+(set! < (lambda (a b) 'mine))
+(lt 1 2) ; => mine
+(define (first l) (car l))
+(first '(1 2)) ; => 1
+(define car cdr)
+(first '(1 2)) ; => (2)
+(define (cond-if c) (if c 'yes 'no))
+(cond-if #t) ; => yes
+(define if (lambda (a b c) c))
+(cond-if #t) ; => no
+(define (folded) (* (* 60 60) 24))
+(folded) ; => 86400
+(define * +)
+(folded) ; => 144
+(define (shadow +) (+ 1 2))
+(shadow -) ; => -1
+(define (fix a b) (- a b))
+(fix 10 4) ; => 6
+(fix 10 #t)
+(fix 10 4) ; => 6
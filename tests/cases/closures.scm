@@ -0,0 +1,57 @@
+; closures over arguments, flat closures copy the arguments nothing assigns
+(define (adder n) (lambda (x) (+ x n)))
+(define add5 (adder 5))
+(add5 10) ; => 15
+((adder 1) 2) ; => 3
+(define (counter n) (lambda () (set! n (+ n 1)) n))
+(define tick (counter 0))
+(tick) ; => 1
+(tick) ; => 2
+(define (shared n) (cons (lambda () n) (lambda (v) (set! n v))))
+(define box (shared 1))
+((cdr box) 42)
+((car box)) ; => 42
+(define (late x) (define g (lambda () x)) (set! x 5) g)
+((late 7)) ; => 5
+(define (nested x) (lambda () (lambda () x)))
+(((nested 3))) ; => 3
+(define (nested-set x) (define g (lambda () (lambda () x))) (set! x 4) g)
+(((nested-set 3))) ; => 4
+(define (redefined x) (define g (lambda () x)) (define x 6) g)
+((redefined 1)) ; => 6
+
+; set!, define and lambda under other names
+(define s! set!)
+(define (mk x) (define g (lambda () x)) (s! x 5) g)
+((mk 7)) ; => 5
+(define d! define)
+(define (mk-define x) (define g (lambda () x)) (d! x 8) g)
+((mk-define 7)) ; => 8
+(define fn lambda)
+(define (mk-fn x) (define g (fn () x)) (set! x 9) g)
+((mk-fn 7)) ; => 9
+(define (mk-fn2 x) (define g (fn () x)) (s! x 10) g)
+((mk-fn2 7)) ; => 10
+(define (mk-inner x) (define g (lambda () x)) ((lambda () (s! x 11))) g)
+((mk-inner 7)) ; => 11
+(define (mk-arg x f) (define g (lambda () x)) (f x 12) g)
+((mk-arg 7 set!)) ; => 12
+((mk-arg 7 +)) ; => 7
+(define (mk-local x) (define g (lambda () x)) (define f set!) (f x 13) g)
+((mk-local 7)) ; => 13
+
+; a name the body calls becomes set! after the body was converted
+(define (helper a b) b)
+(define (mk-helper x) (define g (lambda () x)) (helper x 14) g)
+((mk-helper 7)) ; => 7
+(define helper set!)
+((mk-helper 7)) ; => 14
+(define (mk-later x) (define g (lambda () x)) (later x 15) g)
+(define later set!)
+((mk-later 7)) ; => 15
+(define (mk-builtin x) (define g (lambda () x)) (max x 16) g)
+((mk-builtin 7)) ; => 7
+(define max set!)
+((mk-builtin 7)) ; => 16
+(define (mk-nested x) (lambda () (define h (lambda () x)) (helper x 17) h))
+(((mk-nested 7))) ; => 17
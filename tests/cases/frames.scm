@@ -0,0 +1,68 @@
+; frames of calls that create no closures go back to the pool, the others must survive
+(define (fib n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))
+(fib 15) ; => 610
+(define mk lambda)
+(define (hidden n) (mk () n))
+(define h1 (hidden 1))
+(define h2 (hidden 2))
+(fib 10) ; => 55
+(list (h1) (h2)) ; => (1 2)
+(define (hidden2 a b) (define f (mk (x) (list a b x))) f)
+(define g1 (hidden2 1 2))
+(define g2 (hidden2 3 4))
+(fib 10) ; => 55
+(list (g1 5) (g2 6)) ; => ((1 2 5) (3 4 6))
+(define (proto n) (define get (lambda (x) (+ x n))) (fib 5) get)
+(define r1 (proto 7))
+(define r2 (proto 8))
+(fib 10) ; => 55
+(list (r1 1) (r2 1)) ; => (8 9)
+(define (keep a b) (lambda () (list a b)))
+(define k1 (keep 1 2))
+(fib 10) ; => 55
+(k1) ; => (1 2)
+(define (counter n) (lambda () (set! n (+ n 1)) n))
+(define c1 (counter 10))
+(define c2 (counter 20))
+(fib 10) ; => 55
+(list (c1) (c2) (c1)) ; => (11 21 12)
+(define (hidden-counter n) (mk () (set! n (+ n 1)) n))
+(define c3 (hidden-counter 30))
+(define c4 (hidden-counter 40))
+(fib 10) ; => 55
+(list (c3) (c4) (c3)) ; => (31 41 32)
+; the pool is emptied by the collection after every line, so these create and call closures in
+; one line, the frames of the calls in between would take the frames the closures keep
+(define (use a b) (fib 5) (list (a) (b) (a)))
+(use (counter 10) (counter 20)) ; => (11 21 12)
+(use (hidden-counter 10) (hidden-counter 20)) ; => (11 21 12)
+(use (hidden 1) (keep 2 3)) ; => (1 (2 3) 1)
+((lambda (f) (fib 5) (list (f 1) (f 2))) (proto 3)) ; => (4 5)
+(define (outer a) (define (inner b) (+ a b)) (list (inner 1) (inner 2)))
+(outer 10) ; => (11 12)
+(define (twice f x) (f (f x)))
+(define (inc x) (+ x 1))
+(twice inc 5) ; => 7
+(twice (mk (x) (* x 2)) 5) ; => 20
+(define (args3 a b c) (list c b a))
+(args3 (fib 5) (args3 1 2 3) (fib 6)) ; => (8 (3 2 1) 5)
+
+; frames of calls left by an error
+(define (count n) (if (= n 0) 'done (count (- n 1))))
+(count 5000) ; => done
+(define (sum l) (if (null? l) 0 (+ (car l) (sum (cdr l)))))
+(sum '(1 2 3 4 5)) ; => 15
+(define (bad n) (if (= n 0) (car 1) (+ 1 (bad (- n 1)))))
+(bad 20) ; => Runtime Error: car arguments must be lists
+(fib 12) ; => 144
+(list (h1) (h2) (g1 7) (k1)) ; => (1 2 (1 2 7) (1 2))
+
+; the heap collects while frames and closures are built
+(define (range n acc) (if (= n 0) acc (range (- n 1) (cons n acc))))
+(define (make n) (define junk (range 50 '())) (lambda () (+ n (car junk))))
+(define (makes n acc) (if (= n 0) acc (makes (- n 1) (cons (make n) acc))))
+(define (calls l acc) (if (null? l) acc (calls (cdr l) (+ acc ((car l))))))
+(calls (makes 300 '()) 0) ; => 45450
+(define (tree d) (if (= d 0) '() (cons (tree (- d 1)) (tree (- d 1)))))
+(define (leaves t) (if (null? t) 1 (+ (leaves (car t)) (leaves (cdr t)))))
+(leaves (tree 12)) ; => 4096
@@ -0,0 +1,62 @@
+; numeric lambdas the JIT compiles, with the values and errors of the bailouts
+(define (fib n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))
+(fib 20) ; => 6765
+(define (tak x y z) (if (< y x) (tak (tak (- x 1) y z) (tak (- y 1) z x) (tak (- z 1) x y)) z))
+(tak 18 12 6) ; => 7
+(define (sum n acc) (if (= n 0) acc (sum (- n 1) (+ acc n))))
+(sum 100000 0) ; => 5000050000
+(define (cmp a b) (+ (if (= a b) 1 0) (if (< a b) 10 0) (if (> a b) 100 0) (if (<= a b) 1000 0) (if (>= a b) 10000 0)))
+(define (cmps n acc) (if (= n 0) acc (cmps (- n 1) (+ acc (cmp n 50)))))
+(cmps 100 0) ; => 565491
+(cmp -3 -3) ; => 11001
+(define (neg n) (- n))
+(define (negs n acc) (if (= n 0) acc (negs (- n 1) (+ acc (neg n)))))
+(negs 100 0) ; => -5050
+(define (sign n) (if (> n 0) #t))
+(define (signs n) (if (= n 0) (sign 0) (signs (- n 1))))
+(define (count n) (sign n) (if (> n 0) (count (- n 1)) (sign n)))
+(count 100) ; => ()
+(sign 1) ; => #t
+(sign -1) ; => ()
+(define (pick c a b) (if c a b))
+(define (picks n) (if (= n 0) (pick #t '(1 2) 3) (picks (- n 1))))
+(picks 100) ; => (1 2)
+(pick #f '(1 2) '(3)) ; => (3)
+(pick 0 'a 'b) ; => a
+(define (add1 x) (+ x 1))
+(define (adds n) (if (= n 0) 0 (+ (add1 n) (adds (- n 1)))))
+(adds 100) ; => 5150
+(add1 #t) ; => Runtime Error: + arguments must be numbers
+(add1 '(1)) ; => Runtime Error: + arguments must be numbers
+(add1 -7) ; => -6
+(define (sq x) (* x x))
+(define (sqs n) (if (= n 0) 0 (+ (sq n) (sqs (- n 1)))))
+(sqs 100) ; => 338350
+(sq (* 65536 32768)) ; => 4611686018427387904
+(sq (- 0 (* 65536 32768))) ; => 4611686018427387904
+(define (pow2 n acc) (if (= n 0) acc (pow2 (- n 1) (* acc 2))))
+(pow2 30 1) ; => 1073741824
+(pow2 62 1) ; => 4611686018427387904
+(define (sub-big n) (- n (* 1024 1024 1024 1024 1024 1024)))
+(sub-big 0) ; => -1152921504606846976
+(sub-big (- 0 (* 1024 1024 1024 1024 1024 1024))) ; => -2305843009213693952
+(define (neg-big n) (- n))
+(neg-big (* 1024 1024 1024 1024 1024 1024 4)) ; => -4611686018427387904
+(define (noarity a b) (if (= a 0) b (noarity (- a 1))))
+(noarity 3 1) ; => Runtime Error: lambda must have as much arguments as prototype has
+(define (down n) (if (= n 0) 0 (down (- n 1))))
+(down 100) ; => 0
+(define old-down down)
+(define (down n) 42)
+(old-down 5) ; => 42
+(down 5) ; => 42
+(define (deep n) (if (= n 0) 0 (+ 1 (deep (- n 1)))))
+(deep 10000) ; => 10000
+(deep 10000) ; => 10000
+(define (inc x) (+ x 1))
+(define (incs n) (if (= n 0) 0 (+ (inc n) (incs (- n 1)))))
+(incs 100) ; => 5150
+(define + -)
+(inc 5) ; => 4
+(incs 3) ; => 1
+(neg-big (* -1 1024 1024 1024 1024 1024 1024 4)) ; => 4611686018427387904
@@ -0,0 +1,21 @@
+; calls in tail position run in constant stack in every evaluator
+(define (count n) (if (= n 0) 'done (count (- n 1))))
+(count 100000) ; => done
+(define (sum n acc) (if (= n 0) acc (sum (- n 1) (+ acc n))))
+(sum 100000 0) ; => 5000050000
+(define (evod n) (define (ev? k) (if (= k 0) #t (od? (- k 1)))) (define (od? k) (if (= k 0) #f (ev? (- k 1)))) (ev? n))
+(evod 100001) ; => #f
+(define (loop-and n) (and #t (if (= n 0) 'and-done (loop-and (- n 1)))))
+(loop-and 100000) ; => and-done
+(define (loop-or n) (or #f (if (= n 0) 'or-done (loop-or (- n 1)))))
+(loop-or 100000) ; => or-done
+(define (loop-body n) (define m (- n 1)) (if (< m 0) 'body-done (loop-body m)))
+(loop-body 100000) ; => body-done
+(define (ping n) (if (= n 0) 'ping (pong (- n 1))))
+(define (pong n) (if (= n 0) 'pong (ping (- n 1))))
+(ping 100001) ; => pong
+(define (build n acc) (if (= n 0) acc (build (- n 1) (cons n acc))))
+(define (len l acc) (if (null? l) acc (len (cdr l) (+ acc 1))))
+(len (build 20000 '()) 0) ; => 20000
+(define (last l) (if (null? (cdr l)) (car l) (last (cdr l))))
+(last (build 50000 '())) ; => 50000
@@ -0,0 +1,156 @@
+#include "error.h"
+#include "heap.h"
+#include "scheme.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Runs every .scm file of the directory given on the command line under each configuration of
+// the interpreter: both evaluators, with and without the JIT where it is supported, and with
+// the heap collecting every few allocations. Each file gets a fresh interpreter per
+// configuration, the test checks that all of them print the same thing for every line. A line may end with `; => value`, then the value is checked as well.
+// Lines starting with `;` are comments.
+// Usage: scheme_tests <cases-directory>
+
+namespace {
+
+struct Config {
+    std::string name;
+    Evaluator evaluator;
+    // lambdas are compiled from their first call, so the native code runs every call it can
+    size_t jit_threshold = 0;
+    // stress configurations collect every few allocations
+    size_t young_limit = Heap::kDefaultYoungLimit;
+    size_t slice_budget = 0;
+    size_t threads = 1;
+    bool copying = false;
+};
+
+const std::vector<Config> kConfigs = {
+    {"tree", Evaluator::kTree},
+    {"bytecode", Evaluator::kBytecode},
+    {"tree/jit", Evaluator::kTree, 1},
+    {"bytecode/jit", Evaluator::kBytecode, 1},
+    {"tree/stress", Evaluator::kTree, 0, 1 << 10, 16, 1, true},
+    {"bytecode/stress", Evaluator::kBytecode, 0, 1 << 10, 0, 2, false},
+};
+
+const std::string kExpectation = "; =>";
+
+struct Line {
+    size_t number;
+    std::string expression;
+    // empty if the line is only checked against the other configurations
+    std::string expected;
+};
+
+std::string Trim(const std::string& str) {
+    size_t begin = str.find_first_not_of(" \t");
+    if (begin == std::string::npos) {
+        return "";
+    }
+    return str.substr(begin, str.find_last_not_of(" \t") + 1 - begin);
+}
+
+std::vector<Line> ReadLines(const std::filesystem::path& path) {
+    std::ifstream file(path);
+    std::vector<Line> lines;
+    std::string text;
+    for (size_t number = 1; std::getline(file, text); ++number) {
+        text = Trim(text);
+        if (text.empty() || text[0] == ';') {
+            continue;
+        }
+        Line line{number, text, ""};
+        if (size_t mark = text.find(kExpectation); mark != std::string::npos) {
+            line.expression = Trim(text.substr(0, mark));
+            line.expected = Trim(text.substr(mark + kExpectation.size()));
+        }
+        lines.push_back(std::move(line));
+    }
+    return lines;
+}
+
+// what the REPL prints for the line
+std::string Run(Interpreter& scheme, const std::string& expression) {
+    try {
+        return scheme.Run(expression);
+    } catch (const SyntaxError& ex) {
+        return std::string("Syntax Error: ") + ex.what();
+    } catch (const RuntimeError& ex) {
+        return std::string("Runtime Error: ") + ex.what();
+    } catch (const NameError& ex) {
+        return std::string("Name Error: ") + ex.what();
+    }
+}
+
+std::vector<std::string> RunFile(const Config& config, const std::vector<Line>& lines) {
+    auto& heap = Heap::GetHeap();
+    heap.SetYoungLimit(config.young_limit);
+    heap.SetSliceBudget(config.slice_budget);
+    heap.SetThreadCount(config.threads);
+    heap.SetCopying(config.copying);
+    std::vector<std::string> results;
+    {
+        Interpreter scheme(config.evaluator);
+        scheme.SetJitThreshold(config.jit_threshold);
+        for (const auto& line : lines) {
+            results.push_back(Run(scheme, line.expression));
+        }
+    }
+    heap.SetYoungLimit(Heap::kDefaultYoungLimit);
+    heap.SetSliceBudget(0);
+    heap.SetThreadCount(1);
+    heap.SetCopying(false);
+    return results;
+}
+
+// returns the number of failed lines
+size_t CheckFile(const std::filesystem::path& path) {
+    auto lines = ReadLines(path);
+    std::vector<std::vector<std::string>> results;
+    for (const auto& config : kConfigs) {
+        results.push_back(RunFile(config, lines));
+    }
+    size_t failures = 0;
+    for (size_t id = 0; id < lines.size(); ++id) {
+        const auto& line = lines[id];
+        const std::string& expected = line.expected.empty() ? results[0][id] : line.expected;
+        for (size_t config = 0; config < kConfigs.size(); ++config) {
+            if (results[config][id] != expected) {
+                std::cout << path.filename().string() << ":" << line.number << " ["
+                          << kConfigs[config].name << "] " << line.expression << "\n"
+                          << "  expected: " << expected << "\n"
+                          << "  actual:   " << results[config][id] << "\n";
+                ++failures;
+            }
+        }
+    }
+    return failures;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        std::cerr << "Usage: scheme_tests <cases-directory>\n";
+        return 2;
+    }
+    std::vector<std::filesystem::path> files;
+    for (const auto& entry : std::filesystem::directory_iterator(argv[1])) {
+        if (entry.path().extension() == ".scm") {
+            files.push_back(entry.path());
+        }
+    }
+    std::sort(files.begin(), files.end());
+    size_t failures = 0;
+    for (const auto& file : files) {
+        failures += CheckFile(file);
+    }
+    std::cout << files.size() << " files, " << failures << " failures\n";
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,405 @@
+#include "vm.h"
+
+#include "compiler.h"
+#include "constants.h"
+#include "error.h"
+#include "heap.h"
+#include "jit.h"
+#include "object.h"
+#include "scope.h"
+
+#include <algorithm>
+#include <string>
+
+namespace {
+
+// name of the builtin implemented by an arithmetic or comparison op
+const std::string& GetOpContext(Op op) {
+    switch (op) {
+        case Op::kAdd:
+            return kPlus;
+        case Op::kMultiply:
+            return kMultiply;
+        case Op::kSubtract:
+            return kMinus;
+        case Op::kDivide:
+            return kDivide;
+        case Op::kMax:
+            return kMax;
+        case Op::kMin:
+            return kMin;
+        case Op::kEqual:
+            return kEqual;
+        case Op::kLess:
+            return kLess;
+        case Op::kGreater:
+            return kGreater;
+        case Op::kLessEqual:
+            return kLEqual;
+        default:
+            return kGEqual;
+    }
+}
+
+int64_t Apply(Op op, int64_t a, int64_t b) {
+    switch (op) {
+        case Op::kAdd:
+            return a + b;
+        case Op::kMultiply:
+            return a * b;
+        case Op::kSubtract:
+            return a - b;
+        case Op::kDivide:
+            if (b == 0) {
+                throw RuntimeError(kDivide + kZeroDivision);
+            }
+            return a / b;
+        case Op::kMax:
+            return std::max(a, b);
+        default:
+            return std::min(a, b);
+    }
+}
+
+bool Compare(Op op, int64_t a, int64_t b) {
+    switch (op) {
+        case Op::kEqual:
+            return a == b;
+        case Op::kLess:
+            return a < b;
+        case Op::kGreater:
+            return a > b;
+        case Op::kLessEqual:
+            return a <= b;
+        default:
+            return a >= b;
+    }
+}
+
+bool IsFalse(Object* obj) {
+    return Is<Bool>(obj) && !GetBoolValue(obj);
+}
+
+// returns the value on top of the stack from the current frame
+const uint32_t kReturnOp[] = {static_cast<uint32_t>(Op::kReturn)};
+
+}  // namespace
+
+Object* VM::Execute(Object* code, Object* scope) {
+    RootList stack_root(stack_);
+    RootList frames_root(frame_objects_);
+    size_t entry_frames = frames_.size();
+    size_t entry_stack = stack_.size();
+    try {
+        return Run(code, scope, entry_frames);
+    } catch (...) {
+        stack_.resize(entry_stack);
+        frames_.resize(entry_frames);
+        frame_objects_.resize(2 * entry_frames);
+        throw;
+    }
+}
+
+void VM::SetMaxDepth(size_t depth) {
+    max_depth_ = depth;
+}
+
+Object* VM::GetBodyCode(Object* lambda) {
+    auto layout = As<FrameLayout>(As<Lambda>(lambda)->GetLayout());
+    if (!layout->GetCode()) {
+        if (Object* code = Compiler::CompileBody(As<Lambda>(lambda)->GetBody(),
+                                                 As<Lambda>(lambda)->GetScope())) {
+            layout->SetCode(code);
+        }
+    }
+    return layout->GetCode();
+}
+
+Object* VM::MakeFrame(size_t argc) {
+    size_t base = stack_.size() - argc - 1;
+    auto lambda = static_cast<Lambda*>(stack_[base]);
+    Object* frame = Heap::GetHeap().MakeFrame(lambda->GetScope(), lambda->GetLayout());
+    for (size_t id = 0; id < argc; ++id) {
+        static_cast<Scope*>(frame)->SetSlot(id, stack_[base + 1 + id]);
+    }
+    return frame;
+}
+
+Object* VM::GetFrameCode(Object* frame) {
+    return As<FrameLayout>(static_cast<Scope*>(frame)->GetLayout())->GetCode();
+}
+
+Object* VM::Run(Object* code, Object* scope, size_t entry_frames) {
+    const uint32_t* start;
+    const uint32_t* pc;
+    Object* const* constants;
+    auto enter = [&](Object* new_code, Object* new_scope) {
+        start = static_cast<Code*>(new_code)->GetOps().data();
+        constants = static_cast<Code*>(new_code)->GetConstants().data();
+        scope = new_scope;
+    };
+    frames_.push_back({nullptr, stack_.size()});
+    frame_objects_.push_back(code);
+    frame_objects_.push_back(scope);
+    enter(code, scope);
+    pc = start;
+    // the scope the code is entered with belongs to the caller, until a tail call replaces it
+    bool owns_entry_frame = false;
+    auto owns_frame = [&] { return frames_.size() > entry_frames + 1 || owns_entry_frame; };
+
+    while (true) {
+        switch (static_cast<Op>(*pc)) {
+            case Op::kConst:
+                stack_.push_back(constants[pc[1]]);
+                pc += 2;
+                break;
+            case Op::kLoadLocal:
+                stack_.push_back(static_cast<Scope*>(scope)->GetLocal(pc[1], pc[2], pc[3]));
+                pc += 4;
+                break;
+            case Op::kLoadGlobal:
+                stack_.push_back(static_cast<Scope*>(scope)->GetGlobal(
+                    static_cast<GlobalSymbol*>(constants[pc[1]])));
+                pc += 2;
+                break;
+            case Op::kLoadName:
+                stack_.push_back(static_cast<Scope*>(scope)->GetObject(pc[1]));
+                pc += 2;
+                break;
+            case Op::kEvalEmpty:
+                throw RuntimeError("Can't evaluate empty list");
+            case Op::kEvalDot:
+                throw RuntimeError("Can't evaluate dot");
+            case Op::kPop:
+                stack_.pop_back();
+                ++pc;
+                break;
+            case Op::kJump:
+                pc = start + pc[1];
+                break;
+            case Op::kJumpIfFalse: {
+                Object* value = stack_.back();
+                stack_.pop_back();
+                pc = IsFalse(value) ? start + pc[1] : pc + 2;
+                break;
+            }
+            case Op::kJumpIfBool: {
+                Object* value = stack_.back();
+                if (Is<Bool>(value) && GetBoolValue(value) == static_cast<bool>(pc[1])) {
+                    pc = start + pc[2];
+                } else {
+                    stack_.pop_back();
+                    pc += 3;
+                }
+                break;
+            }
+            case Op::kGuard:
+                if (stack_.back() == constants[pc[1]]) {
+                    stack_.pop_back();
+                    pc += 3;
+                } else {
+                    pc = start + pc[2];
+                }
+                break;
+            case Op::kCheckEpoch:
+                if (Scope::GetBuiltinEpoch() ==
+                    static_cast<size_t>(GetFixnumValue(constants[pc[1]]))) {
+                    pc += 3;
+                } else {
+                    pc = start + pc[2];
+                }
+                break;
+            case Op::kPrepareCall: {
+                Object* func = stack_.back();
+                // a lambda with a malformed body raises its error from Lambda::Call
+                if (Is<Lambda>(func) && GetBodyCode(func)) {
+                    auto layout = As<FrameLayout>(As<Lambda>(func)->GetLayout());
+                    if (pc[1] != layout->GetArgCount()) {
+                        throw RuntimeError(kLambda +
+                                           " must have as much arguments as prototype has");
+                    }
+                    pc += 4;
+                    break;
+                }
+                if (!Is<Function>(func)) {
+                    throw RuntimeError("Unknown function");
+                }
+                stack_.back() = static_cast<Function*>(func)->Call(constants[pc[2]], scope);
+                pc = start + pc[3];
+                break;
+            }
+            case Op::kCall: {
+                if (frames_.size() >= max_depth_) {
+                    throw RuntimeError(kTooDeep);
+                }
+                size_t base = stack_.size() - pc[1] - 1;
+                Object* frame = MakeFrame(pc[1]);
+                stack_.resize(base);
+                Object* result;
+                if (Jit::Run(frame, result, max_depth_ - frames_.size())) {
+                    Heap::GetHeap().ReleaseFrame(frame);
+                    stack_.push_back(result);
+                    pc += 2;
+                    break;
+                }
+                Object* body = GetFrameCode(frame);
+                frames_.push_back({pc + 2, base});
+                frame_objects_.push_back(body);
+                frame_objects_.push_back(frame);
+                enter(body, frame);
+                pc = start;
+                break;
+            }
+            case Op::kTailCall: {
+                Object* frame = MakeFrame(pc[1]);
+                // the caller's return address and stack base are kept
+                stack_.resize(frames_.back().stack_base);
+                Object* result;
+                if (Jit::Run(frame, result, max_depth_ - frames_.size())) {
+                    Heap::GetHeap().ReleaseFrame(frame);
+                    stack_.push_back(result);
+                    pc = kReturnOp;
+                    break;
+                }
+                Object* body = GetFrameCode(frame);
+                if (owns_frame()) {
+                    Heap::GetHeap().ReleaseFrame(frame_objects_.back());
+                }
+                owns_entry_frame = owns_entry_frame || frames_.size() == entry_frames + 1;
+                frame_objects_[frame_objects_.size() - 2] = body;
+                frame_objects_.back() = frame;
+                enter(body, frame);
+                pc = start;
+                break;
+            }
+            case Op::kCallFunction: {
+                Object* func = stack_.back();
+                if (!Is<Function>(func)) {
+                    throw RuntimeError("Unknown function");
+                }
+                stack_.back() = static_cast<Function*>(func)->Call(constants[pc[1]], scope);
+                pc += 2;
+                break;
+            }
+            case Op::kCallPrimitive: {
+                size_t base = stack_.size() - pc[2];
+                Object* result =
+                    static_cast<Reserved*>(constants[pc[1]])->GetPrimitive()(&stack_[base]);
+                stack_.resize(base);
+                stack_.push_back(result);
+                pc += 3;
+                break;
+            }
+            case Op::kReturn: {
+                Object* result = stack_.back();
+                Frame frame = frames_.back();
+                if (owns_frame()) {
+                    Heap::GetHeap().ReleaseFrame(frame_objects_.back());
+                }
+                frames_.pop_back();
+                frame_objects_.resize(frame_objects_.size() - 2);
+                stack_.resize(frame.stack_base);
+                if (frames_.size() == entry_frames) {
+                    return result;
+                }
+                enter(frame_objects_[frame_objects_.size() - 2], frame_objects_.back());
+                pc = frame.return_pc;
+                stack_.push_back(result);
+                break;
+            }
+            case Op::kCheckNumber:
+                if (!Is<Number>(stack_.back())) {
+                    throw RuntimeError(GetOpContext(static_cast<Op>(pc[1])) + kMustBeNum);
+                }
+                pc += 2;
+                break;
+            case Op::kAdd:
+            case Op::kMultiply:
+            case Op::kSubtract:
+            case Op::kDivide:
+            case Op::kMax:
+            case Op::kMin: {
+                auto op = static_cast<Op>(*pc);
+                Object* value = stack_.back();
+                if (!Is<Number>(value)) {
+                    throw RuntimeError(GetOpContext(op) + kMustBeNum);
+                }
+                stack_.pop_back();
+                stack_.back() = MakeNumber(
+                    Apply(op, GetNumberValue(stack_.back()), GetNumberValue(value)));
+                ++pc;
+                break;
+            }
+            case Op::kNegate:
+                stack_.back() = MakeNumber(-GetNumberValue(stack_.back()));
+                ++pc;
+                break;
+            case Op::kEqual:
+            case Op::kLess:
+            case Op::kGreater:
+            case Op::kLessEqual:
+            case Op::kGreaterEqual: {
+                auto op = static_cast<Op>(*pc);
+                Object* value = stack_.back();
+                if (!Is<Number>(value)) {
+                    throw RuntimeError(GetOpContext(op) + kMustBeNum);
+                }
+                stack_.pop_back();
+                bool holds = Compare(op, GetNumberValue(stack_.back()), GetNumberValue(value));
+                if (!pc[1]) {
+                    stack_.back() = MakeBool(holds);
+                    pc += 2;
+                } else if (holds) {
+                    stack_.back() = value;
+                    pc += 2;
+                } else {
+                    stack_.pop_back();
+                    pc = start + pc[1];
+                }
+                break;
+            }
+            case Op::kCar:
+            case Op::kCdr: {
+                bool car = static_cast<Op>(*pc) == Op::kCar;
+                Object* value = stack_.back();
+                if (!Is<Cell>(value)) {
+                    throw RuntimeError((car ? kCar : kCdr) + kMustBeList);
+                }
+                stack_.back() = car ? As<Cell>(value)->GetFirst() : As<Cell>(value)->GetSecond();
+                ++pc;
+                break;
+            }
+            case Op::kCons: {
+                Object* cell = Heap::GetHeap().Make<Cell>();
+                As<Cell>(cell)->SetFirst(stack_[stack_.size() - 2]);
+                As<Cell>(cell)->SetSecond(stack_.back());
+                stack_.pop_back();
+                stack_.back() = cell;
+                ++pc;
+                break;
+            }
+            case Op::kList: {
+                Object* list = nullptr;
+                Root list_root(list);
+                for (uint32_t id = 0; id < pc[1]; ++id) {
+                    Object* cell = Heap::GetHeap().Make<Cell>();
+                    As<Cell>(cell)->SetFirst(stack_[stack_.size() - 1 - id]);
+                    As<Cell>(cell)->SetSecond(list);
+                    list = cell;
+                }
+                stack_.resize(stack_.size() - pc[1]);
+                stack_.push_back(list);
+                pc += 2;
+                break;
+            }
+            case Op::kIsNull:
+                stack_.back() = MakeBool(stack_.back() == nullptr);
+                ++pc;
+                break;
+            case Op::kNot:
+                stack_.back() = MakeBool(IsFalse(stack_.back()));
+                ++pc;
+                break;
+        }
+    }
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "object_fwd.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Stack machine running the bytecode made by Compiler. Calls of lambdas push a frame onto the
+// VM's own call stack instead of recursing on the C++ stack, calls in tail position replace the
+// frame of the caller. Lambda bodies are compiled on their first call and the code is kept in the
+// FrameLayout of the lambda.
+class VM {
+public:
+    static constexpr size_t kDefaultMaxDepth = 1 << 20;
+
+    VM() = default;
+    VM(const VM& other) = delete;
+    VM& operator=(const VM& other) = delete;
+
+    // runs code made by Compiler::CompileExpression in `scope`
+    Object* Execute(Object* code, Object* scope);
+
+    // calls nested deeper than `depth` frames raise a RuntimeError
+    void SetMaxDepth(size_t depth);
+
+private:
+    struct Frame {
+        // where the caller continues
+        const uint32_t* return_pc;
+        // operand stack size of the caller without the called function and its arguments
+        size_t stack_base;
+    };
+
+    Object* Run(Object* code, Object* scope, size_t entry_frames);
+    // code of the lambda body, nullptr if the body can't be compiled
+    static Object* GetBodyCode(Object* lambda);
+    // frame of a call of the lambda below `argc` arguments on top of the stack
+    Object* MakeFrame(size_t argc);
+    static Object* GetFrameCode(Object* frame);
+
+    size_t max_depth_ = kDefaultMaxDepth;
+    std::vector<Object*> stack_;
+    std::vector<Frame> frames_;
+    // code and scope of every frame
+    std::vector<Object*> frame_objects_;
+};